@@ -0,0 +1,210 @@
+// Measures how long O3SerialWriter calls take on the board, to pick options per board.
+//
+// Every case runs N calls, first into a null Stream (cost of the library alone), then into the
+// real Serial at several baud rates (cost including the UART). Results are printed as a table at
+// 115200 baud. While the Serial cases run at other baud rates the monitor shows garbage, that is
+// expected, the result line after it is readable again.
+//
+// Try it again with different options, for example:
+//   #define O3_LOG_LINE_BUFFER_SIZE 96
+//   #define O3_LOG_ASYNC_BUFFER_SIZE 512
+// before the #include below.
+#include <O3SerialWriter.h>
+
+// The UART under test. On boards with native USB (Leonardo, RP2040) Serial ignores the baud rate,
+// use Serial1 with a USB-UART adapter to measure the real UART.
+#define BENCH_SERIAL Serial
+
+static const uint32_t reportBaud = 115200;
+static const uint32_t serialBauds[] = { 9600, 115200, 921600 };
+static const uint16_t nullIterations = 2000;
+static const uint16_t serialIterations = 50;
+
+// Discards everything and counts the bytes.
+class NullStream : public Stream {
+public:
+  size_t write(uint8_t) override {
+    bytes++;
+    return 1;
+  }
+  size_t write(const uint8_t*, size_t size) override {
+    bytes += size;
+    return size;
+  }
+  int availableForWrite() override { return 1024; }
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+
+  uint32_t bytes = 0;
+};
+
+NullStream nullStream;
+O3SerialWriter sw;
+
+// Read through volatile so the compiler cannot precompute the lines.
+volatile int backoff = 250;
+volatile int attempt = 3;
+volatile int statusCode = 503;
+
+// Cycle counter where the core has one, otherwise micros() scaled by the clock frequency.
+static uint32_t cycles() {
+#if defined(ARDUINO_ARCH_ESP32)
+  return ESP.getCycleCount();
+#elif defined(ARDUINO_ARCH_RP2040)
+  return rp2040.getCycleCount();
+#else
+  return micros() * (F_CPU / 1000000UL);
+#endif
+}
+
+enum BenchCase : uint8_t {
+  InfoText,
+  Warn3Parts,
+  Warn7Parts,
+  PrintWithLevel,
+  DrawLine,
+  DrawWideLine,
+  PrintFill,
+  DebugFiltered,
+  CaseCount
+};
+
+static const char* caseName(uint8_t benchCase) {
+  switch (benchCase) {
+    case InfoText:       return "info(const char*)";
+    case Warn3Parts:     return "warn 3 parts";
+    case Warn7Parts:     return "warn 7 parts";
+    case PrintWithLevel: return "printWithLevel+println";
+    case DrawLine:       return "drawLine()";
+    case DrawWideLine:   return "drawLine(120)";
+    case PrintFill:      return "print+fill+println";
+    default:             return "debug filtered";
+  }
+}
+
+static void runCase(uint8_t benchCase) {
+  switch (benchCase) {
+    case InfoText:
+      sw.info("Boot");
+      break;
+    case Warn3Parts:
+      sw.warn("Backoff", backoff, "ms");
+      break;
+    case Warn7Parts:
+      sw.warn("HTTP", statusCode, "retry in", backoff, "ms", "attempt", attempt);
+      break;
+    case PrintWithLevel:
+      sw.printWithLevel(O3LogLevel::Warn, "HTTP ");
+      sw.println(statusCode);
+      break;
+    case DrawLine:
+      sw.drawLine();
+      break;
+    case DrawWideLine:
+      sw.drawLine(120);
+      break;
+    case PrintFill:
+      sw.print("rssi");
+      sw.fill(' ', 8);
+      sw.println(statusCode);
+      break;
+    default:
+      sw.debug("adc", backoff, attempt); // minLevel is Info, so this is rejected
+      break;
+  }
+}
+
+struct Result {
+  uint32_t micros;
+  uint32_t cycles;
+};
+
+// Times iterations calls of one case. In async mode the time includes sending the queue.
+static Result measure(uint8_t benchCase, uint16_t iterations) {
+  const uint32_t startMicros = micros();
+  const uint32_t startCycles = cycles();
+  for (uint16_t i = 0; i < iterations; i++) {
+    runCase(benchCase);
+    sw.pump();
+  }
+  sw.drain();
+  Result result;
+  result.cycles = cycles() - startCycles;
+  result.micros = micros() - startMicros;
+  return result;
+}
+
+// baud 0 is the null Stream.
+static void printResult(uint32_t baud, uint8_t benchCase, uint16_t iterations, const Result& result, uint32_t lineBytes) {
+  const uint32_t bytesPerSecond = result.micros > 0 ? static_cast<uint32_t>(static_cast<uint64_t>(lineBytes) * iterations * 1000000UL / result.micros) : 0;
+  if (baud == 0) {
+    BENCH_SERIAL.print(F("null"));
+  } else {
+    BENCH_SERIAL.print(F("serial "));
+    BENCH_SERIAL.print(baud);
+  }
+  BENCH_SERIAL.print('\t');
+  BENCH_SERIAL.print(caseName(benchCase));
+  BENCH_SERIAL.print('\t');
+  BENCH_SERIAL.print(static_cast<float>(result.micros) / iterations, 2);
+  BENCH_SERIAL.print('\t');
+  BENCH_SERIAL.print(result.cycles / iterations);
+  BENCH_SERIAL.print('\t');
+  BENCH_SERIAL.print(bytesPerSecond);
+  BENCH_SERIAL.print('\t');
+  BENCH_SERIAL.println(lineBytes);
+}
+
+static O3SerialWriterOptions benchOptions() {
+  O3SerialWriterOptions options;
+  options.prefix = "NET";
+  options.minLevel = O3LogLevel::Info;
+  options.lineLength = 32;
+  options.lineCharacter = '=';
+  return options;
+}
+
+// Bytes one call of the case produces, counted on the null Stream.
+// Serial has no byte counter, the Serial runs write the same lines.
+static uint32_t lineBytes(uint8_t benchCase) {
+  sw.begin(nullStream, benchOptions());
+  const uint32_t startBytes = nullStream.bytes;
+  runCase(benchCase);
+  sw.drain();
+  return nullStream.bytes - startBytes;
+}
+
+void setup() {
+  BENCH_SERIAL.begin(reportBaud);
+  delay(2000);
+
+  BENCH_SERIAL.println(F("target\tcase\tus/line\tcycles/line\tbytes/s\tbytes/line"));
+
+  for (uint8_t benchCase = 0; benchCase < CaseCount; benchCase++) {
+    const uint32_t bytes = lineBytes(benchCase);
+    const Result result = measure(benchCase, nullIterations);
+    printResult(0, benchCase, nullIterations, result, bytes);
+  }
+
+  for (uint32_t baud : serialBauds) {
+    for (uint8_t benchCase = 0; benchCase < CaseCount; benchCase++) {
+      const uint32_t bytes = lineBytes(benchCase);
+
+      BENCH_SERIAL.flush();
+      BENCH_SERIAL.begin(baud);
+      sw.begin(BENCH_SERIAL, benchOptions());
+      const Result result = measure(benchCase, serialIterations);
+      BENCH_SERIAL.flush();
+
+      BENCH_SERIAL.begin(reportBaud);
+      BENCH_SERIAL.println();
+      printResult(baud, benchCase, serialIterations, result, bytes);
+    }
+  }
+
+  BENCH_SERIAL.println(F("done"));
+}
+
+void loop() {
+}
@@ -0,0 +1,59 @@
+// Keeps the last log lines across a watchdog or software reset and prints them after the reboot.
+// The error in loop() stands for the crash: the board resets, and the next boot shows the lines
+// that led to it.
+#define O3_LOG_PERSIST_BUFFER_SIZE 1024
+#include <O3SerialWriter.h>
+
+#if defined(ARDUINO_ARCH_AVR)
+#include <avr/wdt.h>
+#endif
+
+O3SerialWriter sw;
+
+// O3_LOG_NOINIT keeps this out of the startup code's zeroing, see the README for other boards.
+O3_LOG_NOINIT O3PersistentLog crashLog;
+
+static void resetBoard() {
+#if defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_ESP8266)
+  ESP.restart();
+#elif defined(ARDUINO_ARCH_RP2040)
+  rp2040.reboot();
+#elif defined(ARDUINO_ARCH_AVR)
+  wdt_enable(WDTO_15MS);
+  while (true) {
+  }
+#endif
+}
+
+void setup() {
+#if defined(ARDUINO_ARCH_AVR)
+  // The watchdog stays on after the reset it caused. Bootloaders other than optiboot do not turn it
+  // off, the board would then reset every 15 ms.
+  MCUSR = 0;
+  wdt_disable();
+#endif
+
+  O3SerialWriterOptions options;
+  options.prefix = "APP";
+  sw.begin(Serial, 115200, options);
+  delay(2000);
+
+  if (sw.persistTo(crashLog, O3LogLevel::Info)) {
+    // Printed directly: a log line here would be stored too and show up as part of the old log.
+    Serial.println(F("Lines from before the reset:"));
+    sw.dumpPersisted();
+    sw.clearPersisted();
+  }
+  sw.info("Boot");
+}
+
+void loop() {
+  static int roundNumber = 0;
+  roundNumber++;
+  sw.info("Round", roundNumber, "heap ok");
+  if (roundNumber == 5) {
+    sw.error("Simulated crash in round", roundNumber);
+    resetBoard();
+  }
+  delay(1000);
+}
@@ -0,0 +1,226 @@
+#!/usr/bin/env python3
+"""Decode O3SerialWriter binary records (O3LogFormat::Binary) back into text lines.
+
+Reads from a file, stdin or a serial port and prints the same lines the writer
+would print in text mode, for example:
+
+    [NET] 12345 WARN: HTTP 503 retry in 250 ms attempt 3
+
+Text that is not part of a record (drawLine(), printOptions(), print() chains)
+is passed through unchanged.
+
+Usage:
+    o3log_decode.py capture.bin
+    o3log_decode.py --port /dev/ttyUSB0 --baud 115200   (needs pyserial)
+    some_tool | o3log_decode.py -
+"""
+
+import argparse
+import decimal
+import struct
+import sys
+
+RECORD_START = 0xA5
+SETTINGS_START = 0xA6
+
+LEVELS = {0: "DEBUG", 1: "INFO", 2: "WARN", 3: "ERROR"}
+
+TIMESTAMP_EPOCH = 4
+
+
+class DecodeError(Exception):
+    pass
+
+
+class Reader:
+    """Byte source with one byte of look-ahead."""
+
+    def __init__(self, stream):
+        self.stream = stream
+
+    def byte(self):
+        data = self.stream.read(1)
+        if not data:
+            raise EOFError
+        return data[0]
+
+    def bytes(self, count):
+        data = b""
+        while len(data) < count:
+            chunk = self.stream.read(count - len(data))
+            if not chunk:
+                raise EOFError
+            data += chunk
+        return data
+
+    def cstring(self):
+        data = bytearray()
+        while True:
+            value = self.byte()
+            if value == 0:
+                return data.decode("utf-8", errors="replace")
+            data.append(value)
+
+    def varint(self):
+        result = 0
+        shift = 0
+        while True:
+            value = self.byte()
+            result |= (value & 0x7F) << shift
+            if not value & 0x80:
+                return result
+            shift += 7
+            if shift > 70:
+                raise DecodeError("varint too long")
+
+
+def zigzag(value):
+    return (value >> 1) ^ -(value & 1)
+
+
+def format_float(value, decimals=2):
+    # Same as the writer's text output: 2 decimals unless fixed() chose others, nan/inf/ovf for special values.
+    if value != value:
+        return "nan"
+    if value in (float("inf"), float("-inf")):
+        return "inf"
+    if abs(value) > 4294967040.0:
+        return "ovf"
+    # Half up on the exact binary value, like the writer (Python's own formatting rounds half to even).
+    return str(decimal.Decimal(value).quantize(decimal.Decimal(1).scaleb(-decimals), rounding=decimal.ROUND_HALF_UP))
+
+
+def read_part(reader, tag, decimals=2):
+    if tag == 0x01:
+        return reader.cstring()
+    if tag == 0x02:
+        return str(zigzag(reader.varint()))
+    if tag == 0x03:
+        return str(reader.varint())
+    if tag == 0x04:
+        return format_float(struct.unpack("<f", reader.bytes(4))[0], decimals)
+    if tag == 0x05:
+        return format_float(struct.unpack("<d", reader.bytes(8))[0], decimals)
+    if tag == 0x06:
+        return chr(reader.byte())
+    if tag == 0x07:
+        return "1" if reader.byte() else "0"
+    if tag == 0x08:
+        # kv() part: key, then the value as a regular part.
+        key = reader.cstring()
+        return "%s=%s" % (key, read_part(reader, reader.byte()))
+    if tag == 0x09:
+        # fixed() part: number of decimals, then the float/double part.
+        decimals = min(reader.byte(), 9)
+        return read_part(reader, reader.byte(), decimals)
+    raise DecodeError("unknown part tag 0x%02X" % tag)
+
+
+class Decoder:
+    def __init__(self, out, show_ids=False):
+        self.out = out
+        self.show_ids = show_ids
+        self.prefix = ""
+        self.separator = " "
+        self.show_millis = True
+        self.timestamp_source = 0
+        self.epoch_seconds = 0
+        self.millis_width = 0
+        self.show_level = True
+
+    def timestamp(self, value):
+        if self.timestamp_source == TIMESTAMP_EPOCH:
+            # value counts milliseconds since epoch_seconds.
+            return "%d.%03d" % (self.epoch_seconds + value // 1000, value % 1000)
+        return "%0*d" % (self.millis_width, value)
+
+    def header(self, level, timestamp, callsite):
+        text = ""
+        if self.prefix:
+            text += "[%s] " % self.prefix
+        if self.show_millis:
+            text += self.timestamp(timestamp) + " "
+        if self.show_level:
+            text += "%s: " % LEVELS.get(level, "LOG")
+        if self.show_ids and callsite:
+            text += "#%04X " % callsite
+        return text
+
+    def record(self, reader):
+        level = reader.byte()
+        timestamp = reader.varint()
+        callsite = reader.varint()
+        parts = []
+        while True:
+            tag = reader.byte()
+            if tag == 0:
+                break
+            parts.append(read_part(reader, tag))
+        self.out.write(self.header(level, timestamp, callsite) + self.separator.join(parts) + "\n")
+
+    def settings(self, reader):
+        self.prefix = reader.cstring()
+        self.separator = reader.cstring()
+        flags = reader.byte()
+        self.show_millis = bool(flags & 1)
+        self.timestamp_source = (flags >> 2) & 7
+        if self.timestamp_source == TIMESTAMP_EPOCH:
+            self.epoch_seconds = reader.varint()
+        # Bit 5: the zero padding width of the timestamp follows (writers that do not pad leave it out).
+        self.millis_width = reader.byte() if flags & 0x20 else 0
+        self.show_level = bool(flags & 2)
+
+    def run(self, stream):
+        reader = Reader(stream)
+        text = bytearray()
+        try:
+            while True:
+                value = reader.byte()
+                if value in (RECORD_START, SETTINGS_START):
+                    if text:
+                        self.out.write(text.decode("utf-8", errors="replace"))
+                        text.clear()
+                    try:
+                        if value == RECORD_START:
+                            self.record(reader)
+                        else:
+                            self.settings(reader)
+                    except DecodeError as error:
+                        self.out.write("<decode error: %s>\n" % error)
+                    continue
+                if value == ord("\r"):
+                    continue
+                text.append(value)
+                if value == ord("\n"):
+                    self.out.write(text.decode("utf-8", errors="replace"))
+                    text.clear()
+                    self.out.flush()
+        except EOFError:
+            pass
+        if text:
+            self.out.write(text.decode("utf-8", errors="replace"))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", nargs="?", default="-", help="capture file, or - for stdin")
+    parser.add_argument("--port", help="read from a serial port instead (requires pyserial)")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--ids", action="store_true", help="print callsite ids after the header")
+    args = parser.parse_args()
+
+    decoder = Decoder(sys.stdout, show_ids=args.ids)
+    if args.port:
+        import serial  # pyserial
+
+        with serial.Serial(args.port, args.baud) as port:
+            decoder.run(port)
+    elif args.input == "-":
+        decoder.run(sys.stdin.buffer)
+    else:
+        with open(args.input, "rb") as stream:
+            decoder.run(stream)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,204 @@
+#pragma once
+
+// Minimal Arduino core for building O3SerialWriter on a desktop (Linux, macOS, MSYS2).
+// Only what the library and the examples use: Print, Stream, HardwareSerial, String, Printable,
+// F()/PROGMEM and the timing functions. Print follows the Arduino AVR core closely, including its
+// one write() call per character for print(F(...)) and its digit-by-digit number printing, so
+// the number of virtual write calls per line matches a real board.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+#include <string>
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(PSTR(s)))
+#define pgm_read_byte(address) (*reinterpret_cast<const uint8_t*>(address))
+#define memcpy_P memcpy
+#define strlen_P strlen
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+class __FlashStringHelper;
+
+#if defined(O3_HOST_MANUAL_CLOCK)
+// Tests move the time themselves by setting hostClockMicros.
+inline uint32_t hostClockMicros = 0;
+inline uint32_t micros() { return hostClockMicros; }
+#else
+inline uint32_t micros() {
+  using namespace std::chrono;
+  static const steady_clock::time_point start = steady_clock::now();
+  return static_cast<uint32_t>(duration_cast<microseconds>(steady_clock::now() - start).count());
+}
+#endif
+
+inline uint32_t millis() { return micros() / 1000; }
+inline void delay(uint32_t) {}
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+class Print;
+
+class Printable {
+public:
+  virtual ~Printable() {}
+  virtual size_t printTo(Print& p) const = 0;
+};
+
+class String {
+public:
+  String(const char* value = "") : text(value ? value : "") {}
+  const char* c_str() const { return text.c_str(); }
+  unsigned int length() const { return static_cast<unsigned int>(text.size()); }
+
+private:
+  std::string text;
+};
+
+class Print {
+public:
+  virtual ~Print() {}
+
+  virtual size_t write(uint8_t value) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size) {
+    size_t n = 0;
+    while (size--) {
+      if (write(*buffer++)) n++;
+      else break;
+    }
+    return n;
+  }
+  size_t write(const char* text) { return text ? write(reinterpret_cast<const uint8_t*>(text), strlen(text)) : 0; }
+  size_t write(const char* buffer, size_t size) { return write(reinterpret_cast<const uint8_t*>(buffer), size); }
+
+  virtual int availableForWrite() { return 0; }
+  virtual void flush() {}
+
+  size_t print(const __FlashStringHelper* value) {
+    const char* p = reinterpret_cast<const char*>(value);
+    size_t n = 0;
+    while (true) {
+      const uint8_t c = pgm_read_byte(p++);
+      if (c == 0) break;
+      if (write(c)) n++;
+      else break;
+    }
+    return n;
+  }
+  size_t print(const String& value) { return write(value.c_str(), value.length()); }
+  size_t print(const char* value) { return write(value); }
+  size_t print(char value) { return write(static_cast<uint8_t>(value)); }
+  size_t print(unsigned char value, int base = DEC) { return print(static_cast<unsigned long>(value), base); }
+  size_t print(int value, int base = DEC) { return print(static_cast<long>(value), base); }
+  size_t print(unsigned int value, int base = DEC) { return print(static_cast<unsigned long>(value), base); }
+  size_t print(long value, int base = DEC) {
+    if (base == DEC && value < 0) {
+      const size_t t = print('-');
+      return printNumber(0UL - static_cast<unsigned long>(value), 10) + t;
+    }
+    return printNumber(static_cast<unsigned long>(value), static_cast<uint8_t>(base));
+  }
+  size_t print(unsigned long value, int base = DEC) { return printNumber(value, static_cast<uint8_t>(base)); }
+  size_t print(long long value, int base = DEC) {
+    if (base == DEC && value < 0) {
+      const size_t t = print('-');
+      return printNumber64(0ULL - static_cast<unsigned long long>(value), 10) + t;
+    }
+    return printNumber64(static_cast<unsigned long long>(value), static_cast<uint8_t>(base));
+  }
+  size_t print(unsigned long long value, int base = DEC) { return printNumber64(value, static_cast<uint8_t>(base)); }
+  size_t print(double value, int digits = 2) { return printFloat(value, static_cast<uint8_t>(digits)); }
+  size_t print(const Printable& value) { return value.printTo(*this); }
+
+  size_t println() { return write("\r\n"); }
+  template <typename T>
+  size_t println(const T& value) {
+    const size_t n = print(value);
+    return n + println();
+  }
+  template <typename T>
+  size_t println(const T& value, int option) {
+    const size_t n = print(value, option);
+    return n + println();
+  }
+
+private:
+  size_t printNumber(unsigned long n, uint8_t base) {
+    char buffer[8 * sizeof(long) + 1];
+    char* text = &buffer[sizeof(buffer) - 1];
+    *text = '\0';
+    if (base < 2) base = 10;
+    do {
+      const char c = static_cast<char>(n % base);
+      n /= base;
+      *--text = c < 10 ? c + '0' : c + 'A' - 10;
+    } while (n);
+    return write(text);
+  }
+
+  size_t printNumber64(unsigned long long n, uint8_t base) {
+    char buffer[8 * sizeof(long long) + 1];
+    char* text = &buffer[sizeof(buffer) - 1];
+    *text = '\0';
+    if (base < 2) base = 10;
+    do {
+      const char c = static_cast<char>(n % base);
+      n /= base;
+      *--text = c < 10 ? c + '0' : c + 'A' - 10;
+    } while (n);
+    return write(text);
+  }
+
+  // Same algorithm as the AVR core: round, integer part, then one digit per write().
+  size_t printFloat(double number, uint8_t digits) {
+    if (isnan(number)) return print("nan");
+    if (isinf(number)) return print("inf");
+    if (number > 4294967040.0 || number < -4294967040.0) return print("ovf");
+    size_t n = 0;
+    if (number < 0.0) {
+      n += print('-');
+      number = -number;
+    }
+    double rounding = 0.5;
+    for (uint8_t i = 0; i < digits; ++i) rounding /= 10.0;
+    number += rounding;
+    const unsigned long intPart = static_cast<unsigned long>(number);
+    double remainder = number - static_cast<double>(intPart);
+    n += print(intPart);
+    if (digits > 0) n += print('.');
+    while (digits-- > 0) {
+      remainder *= 10.0;
+      const unsigned int toPrint = static_cast<unsigned int>(remainder);
+      n += print(toPrint);
+      remainder -= toPrint;
+    }
+    return n;
+  }
+};
+
+class Stream : public Print {
+public:
+  virtual int available() { return 0; }
+  virtual int read() { return -1; }
+  virtual int peek() { return -1; }
+};
+
+// Writes to stdout, so the examples can run on the desktop.
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long) {}
+  using Print::write;
+  size_t write(uint8_t value) override { return fputc(value, stdout) == EOF ? 0 : 1; }
+  size_t write(const uint8_t* buffer, size_t size) override { return fwrite(buffer, 1, size, stdout); }
+  int availableForWrite() override { return 64; }
+};
+
+inline HardwareSerial Serial;
@@ -0,0 +1,61 @@
+// Async mode with an extra output, where the main output takes only part of every write
+// (like a WiFiClient or a full HardwareSerial). Both outputs must receive every line exactly once.
+#include <Arduino.h>
+
+#include <O3SerialWriter.h>
+
+// Keeps what it is given, at most limit bytes per write() call.
+class CaptureStream : public Stream {
+public:
+  explicit CaptureStream(size_t writeLimit) : limit(writeLimit) {}
+
+  using Print::write;
+  size_t write(uint8_t value) override { return write(&value, 1); }
+  size_t write(const uint8_t* data, size_t size) override {
+    if (size > limit) size = limit;
+    text.append(reinterpret_cast<const char*>(data), size);
+    return size;
+  }
+
+  size_t limit;
+  std::string text;
+};
+
+static int failures = 0;
+
+static void expectText(const char* name, const std::string& actual, const char* expected) {
+  if (actual == expected) return;
+  printf("FAIL %s\nexpected:\n%s\nactual:\n%s\n", name, expected, actual.c_str());
+  failures++;
+}
+
+int main() {
+  CaptureStream primary(5);
+  CaptureStream extra(1000);
+  O3SerialWriter sw;
+  O3SerialWriterOptions options;
+  options.showMillis = false;
+  sw.begin(primary, options);
+  sw.addSink(extra, O3LogLevel::Debug);
+
+  sw.info("hello world", 12345);
+  sw.warn("second");
+  sw.drain();
+
+  const char* expected = "INFO: hello world 12345\r\nWARN: second\r\n";
+  expectText("primary", primary.text, expected);
+  expectText("extra", extra.text, expected);
+
+  // The extra output is the first one that takes the level, the main output skips it.
+  primary.text.clear();
+  extra.text.clear();
+  extra.limit = 3;
+  sw.setMinLevel(O3LogLevel::Error);
+  sw.info("only extra");
+  sw.drain();
+  expectText("primary filtered", primary.text, "");
+  expectText("extra only", extra.text, "INFO: only extra\r\n");
+
+  if (failures == 0) printf("async_sinks: ok\n");
+  return failures == 0 ? 0 : 1;
+}
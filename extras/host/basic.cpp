@@ -0,0 +1,10 @@
+// Runs examples/Basic on the desktop, output goes to stdout.
+#include <Arduino.h>
+
+#include "../../examples/Basic/Basic.ino"
+
+int main() {
+  setup();
+  loop();
+  return 0;
+}
@@ -0,0 +1,128 @@
+// Host micro-benchmark for O3SerialWriter.
+//
+// Every case logs into a null Stream that only counts, so the numbers show the cost of the
+// library itself: nanoseconds per line, virtual write() calls per line and bytes per line.
+// The buffering modes are compile-time options, CMakeLists.txt builds one binary per mode.
+//
+//   o3_benchmark [iterations]
+
+#include <Arduino.h>
+#include <O3SerialWriter.h>
+
+#include <chrono>
+#include <stdlib.h>
+
+// Discards everything, counts calls and bytes.
+class NullStream : public Stream {
+public:
+  using Print::write;
+  size_t write(uint8_t) override {
+    writeCalls++;
+    bytes++;
+    return 1;
+  }
+  size_t write(const uint8_t*, size_t size) override {
+    writeCalls++;
+    bytes += size;
+    return size;
+  }
+  int availableForWrite() override { return 1 << 20; }
+
+  void reset() {
+    writeCalls = 0;
+    bytes = 0;
+  }
+
+  unsigned long writeCalls = 0;
+  unsigned long bytes = 0;
+};
+
+static NullStream sink;
+static O3SerialWriter sw;
+
+// Values are read through volatile so the compiler cannot fold the formatting away.
+static volatile int backoff = 250;
+static volatile int attempt = 3;
+static volatile int statusCode = 503;
+static volatile float temperature = 21.37f;
+static volatile float humidity = 48.5f;
+static volatile float pressure = 1013.25f;
+
+static O3SerialWriterOptions basicOptions() {
+  O3SerialWriterOptions options;
+  options.prefix = "NET";
+  options.lineLength = 32;
+  options.lineCharacter = '=';
+  return options;
+}
+
+template <typename Body>
+static void run(const char* name, const O3SerialWriterOptions& options, unsigned long iterations, Body body) {
+  sw.configure(options);
+  body(); // warm up
+  sw.drain();
+  sink.reset();
+
+  const auto start = std::chrono::steady_clock::now();
+  for (unsigned long i = 0; i < iterations; i++) {
+    body();
+    sw.pump();
+  }
+  sw.drain();
+  const auto stop = std::chrono::steady_clock::now();
+
+  const double ns = std::chrono::duration<double, std::nano>(stop - start).count();
+  printf("%-28s %10.1f %12.2f %12.1f\n", name, ns / iterations, static_cast<double>(sink.writeCalls) / iterations,
+         static_cast<double>(sink.bytes) / iterations);
+}
+
+int main(int argc, char** argv) {
+  const unsigned long iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200000;
+  sw.begin(sink, basicOptions());
+
+  printf("O3SerialWriter host benchmark: line buffer %d, async buffer %d, %lu iterations\n", O3_LOG_LINE_BUFFER_SIZE,
+         O3_LOG_ASYNC_BUFFER_SIZE, iterations);
+  printf("%-28s %10s %12s %12s\n", "case", "ns/line", "writes/line", "bytes/line");
+
+  const O3SerialWriterOptions basic = basicOptions();
+
+  run("info(\"Boot\")", basic, iterations, [] { sw.info("Boot"); });
+  run("info(F(\"Boot\"))", basic, iterations, [] { sw.info(F("Boot")); });
+  run("info 3 parts", basic, iterations, [] { sw.info("Backoff", backoff, "ms"); });
+  run("warn 7 parts", basic, iterations, [] { sw.warn("HTTP", statusCode, "retry in", backoff, "ms", "attempt", attempt); });
+  run("info 6 parts, 3 floats", basic, iterations, [] { sw.info("T", temperature, "H", humidity, "P", pressure); });
+  run("drawLine()", basic, iterations, [] { sw.drawLine(); });
+  run("drawLine(120)", basic, iterations, [] { sw.drawLine(120); });
+  run("print + fill + println", basic, iterations, [] {
+    sw.print("rssi");
+    sw.fill(' ', 8);
+    sw.println(statusCode);
+  });
+  run("printWithLevel + println", basic, iterations, [] {
+    sw.printWithLevel(O3LogLevel::Warn, "HTTP ");
+    sw.println(statusCode);
+  });
+
+  O3SerialWriterOptions longPrefix = basic;
+  longPrefix.prefix = "SENSOR-GATEWAY-BASEMENT-NODE-07";
+  run("warn 7 parts, long prefix", longPrefix, iterations, [] { sw.warn("HTTP", statusCode, "retry in", backoff, "ms", "attempt", attempt); });
+
+  O3SerialWriterOptions bare = basic;
+  bare.prefix = "";
+  bare.showMillis = false;
+  bare.showLevel = false;
+  run("info 3 parts, no header", bare, iterations, [] { sw.info("Backoff", backoff, "ms"); });
+
+  O3SerialWriterOptions warnOnly = basic;
+  warnOnly.minLevel = O3LogLevel::Warn;
+  run("debug filtered out", warnOnly, iterations, [] { sw.debug("adc", backoff, attempt); });
+
+#if O3_LOG_BINARY_FORMAT
+  O3SerialWriterOptions binary = basic;
+  binary.format = O3LogFormat::Binary;
+  run("warn 7 parts, binary", binary, iterations, [] { sw.warn("HTTP", statusCode, "retry in", backoff, "ms", "attempt", attempt); });
+  run("info 3 floats, binary", binary, iterations, [] { sw.info("T", temperature, "H", humidity, "P", pressure); });
+#endif
+
+  return 0;
+}
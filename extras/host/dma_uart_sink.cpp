@@ -0,0 +1,83 @@
+// O3DmaUartSink with a DMA stub whose transfers finish after a few busy() polls: writes continue
+// into the second buffer while a transfer runs, flushIfDue() starts waiting bytes, nothing is lost.
+#include <Arduino.h>
+
+#include <O3SerialWriter.h>
+#include <O3DmaUartSink.h>
+
+// A transfer stays busy for busyPolls calls of busy(), then its bytes count as sent.
+class FakeDma {
+public:
+  bool begin(int) { return true; }
+
+  bool busy() {
+    if (remainingPolls == 0) return false;
+    if (--remainingPolls == 0) sent.append(reinterpret_cast<const char*>(pending), pendingSize);
+    return true;
+  }
+
+  void start(const uint8_t* data, size_t size) {
+    if (remainingPolls > 0) overlapped = true; // Would corrupt a running transfer
+    starts++;
+    pending = data;
+    pendingSize = size;
+    remainingPolls = busyPolls;
+  }
+
+  void waitSent() {
+    while (busy()) {
+    }
+  }
+
+  int busyPolls = 3;
+  int remainingPolls = 0;
+  int starts = 0;
+  bool overlapped = false;
+  const uint8_t* pending = nullptr;
+  size_t pendingSize = 0;
+  std::string sent;
+};
+
+static int failures = 0;
+
+static void expect(const char* name, bool condition) {
+  if (condition) return;
+  printf("FAIL %s\n", name);
+  failures++;
+}
+
+int main() {
+  O3DmaUartSink<FakeDma, 32> uartOut;
+  O3SerialWriter sw;
+  expect("begin", uartOut.begin(1));
+
+  O3SerialWriterOptions options;
+  options.showMillis = false;
+  sw.begin(uartOut, options);
+
+  std::string expected;
+  for (int i = 0; i < 5; i++) {
+    sw.info("line", i, "with some more text");
+    expected += "INFO: line " + std::to_string(i) + " with some more text\r\n";
+  }
+  expect("transfers started", uartOut.backend().starts > 1);
+  expect("free space", uartOut.availableForWrite() >= 0);
+
+  for (int i = 0; i < 20; i++) uartOut.flushIfDue();
+  uartOut.flush();
+  expect("nothing pending", uartOut.pendingBytes() == 0);
+  expect("no overlap", !uartOut.backend().overlapped);
+  expect("all bytes in order", uartOut.backend().sent == expected);
+
+  // A short line is only started by flushIfDue() once the DMA is idle.
+  uartOut.backend().sent.clear();
+  uartOut.backend().busyPolls = 1000;
+  sw.info("a");
+  sw.info("b");
+  expect("second line waits", uartOut.pendingBytes() > 0);
+  uartOut.flush();
+  expect("short lines sent", uartOut.backend().sent == "INFO: a\r\nINFO: b\r\n");
+
+  if (failures == 0) printf("dma_uart_sink: ok\n");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,110 @@
+// O3FileSink on an in-memory filesystem: page-aligned writes, the flush interval, flushing after
+// an error line and size-based rotation that never splits a line between two files.
+#include <Arduino.h>
+
+#include <map>
+
+#define FILE_APPEND "a"
+
+// Files live in a map, every write() call is counted.
+static std::map<std::string, std::string> files;
+static int fileWrites = 0;
+
+class FakeFile {
+public:
+  explicit operator bool() const { return isOpen; }
+  size_t write(const uint8_t* data, size_t size) {
+    fileWrites++;
+    files[name].append(reinterpret_cast<const char*>(data), size);
+    return size;
+  }
+  void flush() {}
+  size_t size() const { return files[name].size(); }
+  void close() { isOpen = false; }
+
+  std::string name;
+  bool isOpen = false;
+};
+
+class FakeFs {
+public:
+  FakeFile open(const char* path, const char* mode) {
+    FakeFile file;
+    if (strcmp(mode, FILE_APPEND) != 0) return file;
+    file.name = path;
+    file.isOpen = true;
+    files[path];
+    return file;
+  }
+  bool exists(const char* path) { return files.count(path) > 0; }
+  bool remove(const char* path) { return files.erase(path) > 0; }
+  bool rename(const char* from, const char* to) {
+    if (!files.count(from)) return false;
+    files[to] = files[from];
+    files.erase(from);
+    return true;
+  }
+};
+
+#include <O3SerialWriter.h>
+#include <O3FileSink.h>
+
+static int failures = 0;
+
+static void expect(const char* name, bool condition) {
+  if (condition) return;
+  printf("FAIL %s\n", name);
+  failures++;
+}
+
+static void setMillis(uint32_t ms) { hostClockMicros = ms * 1000; }
+
+int main() {
+  FakeFs fs;
+  O3FileSink<FakeFs, 64> logFile;
+  O3SerialWriter sw;
+
+  // An existing file of 10 bytes: the first page ends at byte 64 of the file, not 64 bytes later.
+  files["/log.txt"] = std::string(9, 'x') + "\n";
+  O3FileSinkOptions fileOptions;
+  fileOptions.maxFileSize = 300;
+  fileOptions.maxFiles = 3;
+  fileOptions.flushIntervalMs = 1000;
+  expect("begin", logFile.begin(fs, "/log.txt", fileOptions));
+  expect("existing size", logFile.fileSize() == 10);
+
+  O3SerialWriterOptions options;
+  options.showMillis = false;
+  options.minLevel = O3LogLevel::None; // Only the file gets lines
+  sw.begin(Serial, options);
+  expect("addSink", sw.addSink(logFile, O3LogLevel::Debug));
+  expect("flush level", sw.setSinkFlushLevel(logFile, O3LogLevel::Error));
+
+  sw.info("0123456789012345678901234567"); // 36 bytes with header and line end
+  expect("buffered", fileWrites == 0 && logFile.pendingBytes() == 36);
+  sw.info("0123456789012345678901234567");
+  expect("aligned page", fileWrites == 1 && files["/log.txt"].size() == 64);
+
+  setMillis(500);
+  logFile.flushIfDue();
+  expect("not due yet", fileWrites == 1);
+  setMillis(1000);
+  logFile.flushIfDue();
+  expect("flush interval", fileWrites == 2 && logFile.pendingBytes() == 0);
+
+  sw.error("boom");
+  expect("error flushes", logFile.pendingBytes() == 0 && files["/log.txt"].size() == 95);
+
+  for (int i = 0; i < 40; i++) sw.info("line", i, "padding padding");
+  logFile.flush();
+
+  expect("rotated", files.count("/log.txt.1") == 1 && files.count("/log.txt.2") == 1);
+  expect("oldest removed", files.count("/log.txt.3") == 0);
+  for (const auto& file : files) {
+    expect("whole lines", file.second.empty() || file.second.back() == '\n');
+    if (file.first != "/log.txt") expect("size limit", file.second.size() >= 300 && file.second.size() < 300 + 64 + 64);
+  }
+
+  if (failures == 0) printf("file_sink: ok\n");
+  return failures == 0 ? 0 : 1;
+}
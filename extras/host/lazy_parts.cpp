@@ -0,0 +1,70 @@
+// Lazy parts with the crash log compiled in: the record and the outputs need the value, the lambda
+// must still run only once per line, and both must show the same value.
+#include <Arduino.h>
+
+#include <O3SerialWriter.h>
+
+class CaptureStream : public Stream {
+public:
+  using Print::write;
+  size_t write(uint8_t value) override { return write(&value, 1); }
+  size_t write(const uint8_t* data, size_t size) override {
+    text.append(reinterpret_cast<const char*>(data), size);
+    return size;
+  }
+
+  std::string text;
+};
+
+static int failures = 0;
+
+static void expect(const char* name, bool condition) {
+  if (condition) return;
+  printf("FAIL %s\n", name);
+  failures++;
+}
+
+static void expectText(const char* name, const std::string& actual, const char* expected) {
+  if (actual == expected) return;
+  printf("FAIL %s\nexpected:\n%s\nactual:\n%s\n", name, expected, actual.c_str());
+  failures++;
+}
+
+static O3PersistentLog crashLog;
+static int calls = 0;
+
+int main() {
+  CaptureStream out;
+  O3SerialWriter sw;
+  O3SerialWriterOptions options;
+  options.showMillis = false;
+  sw.begin(out, options);
+  sw.persistTo(crashLog);
+
+  // Every call returns a new number, a second call would show up as a different value.
+  auto next = [] { return ++calls; };
+
+  sw.info("reading", next);
+  expect("part called once", calls == 1);
+  sw.info("kv", sw.kv("n", next), sw.kv("unit", "ms"));
+  expect("kv called once", calls == 2);
+  sw.infof("fmt %d", next);
+  expect("printf called once", calls == 3);
+
+  // Below the output level the line is only stored, the lambda still runs once.
+  sw.setMinLevel(O3LogLevel::Warn);
+  sw.info("stored", next);
+  expect("stored only, called once", calls == 4);
+  sw.setMinLevel(O3LogLevel::Debug);
+
+  expectText("outputs", out.text, "INFO: reading 1\r\nINFO: kv n=2 unit=ms\r\nINFO: fmt 3\r\n");
+
+  // The crash log holds the values the outputs got.
+  out.text.clear();
+  sw.dumpPersisted();
+  expectText("crash log", out.text, "INFO: reading 1\r\nINFO: kv n=2 unit=ms\r\nINFO: fmt 3\r\nINFO: stored 4\r\n");
+  expect("dump calls nothing", calls == 4);
+
+  if (failures == 0) printf("lazy_parts: ok\n");
+  return failures == 0 ? 0 : 1;
+}
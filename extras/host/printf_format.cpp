@@ -0,0 +1,75 @@
+// The printf-style formatter behind infof(): flags, width, precision and the conversions, checked
+// against what the C library prints. Widths above the limit are capped instead of wrapping around.
+#include <Arduino.h>
+
+#include <O3SerialWriter.h>
+
+class CaptureStream : public Stream {
+public:
+  using Print::write;
+  size_t write(uint8_t value) override { return write(&value, 1); }
+  size_t write(const uint8_t* data, size_t size) override {
+    text.append(reinterpret_cast<const char*>(data), size);
+    return size;
+  }
+
+  std::string text;
+};
+
+static int failures = 0;
+static CaptureStream out;
+static O3SerialWriter sw;
+
+// Formats one line with infof() and returns it without the line end.
+template <typename... Args>
+static std::string format(const char* text, const Args&... args) {
+  out.text.clear();
+  sw.infof(text, args...);
+  return out.text.substr(0, out.text.size() - 2);
+}
+
+static void expectText(const char* name, const std::string& actual, const std::string& expected) {
+  if (actual == expected) return;
+  printf("FAIL %s\nexpected: [%s]\nactual:   [%s]\n", name, expected.c_str(), actual.c_str());
+  failures++;
+}
+
+// The same format through snprintf, for the cases where both must agree.
+template <typename... Args>
+static void expectLikePrintf(const char* text, const Args&... args) {
+  char expected[128];
+  snprintf(expected, sizeof(expected), text, args...);
+  expectText(text, format(text, args...), expected);
+}
+
+int main() {
+  O3SerialWriterOptions options;
+  options.showMillis = false;
+  options.showLevel = false;
+  sw.begin(out, options);
+
+  // Flags and width
+  expectLikePrintf("[%5d] [%-5d] [%05d] [%+d] [% d] [%+d]", 42, 42, -42, 5, 5, -5);
+  expectLikePrintf("[%-08d|] [%+05d] [% 5d]", 7, 7, 7);
+  expectLikePrintf("[%u] [%ld] [%lu]", 4000000000u, -123456789L, 3000000000UL);
+
+  // Precision
+  expectLikePrintf("[%.3d] [%8.3d] [%-8.3d|] [%.0d]", 7, -7, 7, 3);
+  expectLikePrintf("[%.3f] [%8.2f] [%-8.1f|] [%+.2f] [%.0f]", 3.14159, -2.5, 1.26, 0.5, 2.0);
+  expectLikePrintf("[%.2s] [%8s] [%-8s|] [%5s]", "abcdef", "ab", "ab", "toolongvalue");
+
+  // Hex, octal, characters and percent signs
+  expectLikePrintf("[%x] [%X] [%o] [%08x] [%#x] [%#X] [%#o]", 0xbeefu, 0xbeefu, 8u, 0xabu, 255u, 255u, 8u);
+  expectLikePrintf("[%c] [%3c] [%-3c|] [%%] [100%%]", 'z', 'a', 'b');
+
+  // '#' leaves a zero alone: "0", not "0x0"
+  expectLikePrintf("[%#x] [%#X] [%#o] [%#5x]", 0u, 0u, 0u, 0u);
+
+  // Widths and precisions above the limit are capped, a huge one must not wrap to a small width.
+  expectText("width cap", format("[%300d]", 7), "[" + std::string(63, ' ') + "7]");
+  expectText("width cap digits", format("[%99999999999d]", 7), "[" + std::string(63, ' ') + "7]");
+  expectText("precision cap", format("[%.300d]", 7), "[" + std::string(63, '0') + "7]");
+
+  if (failures == 0) printf("printf_format: ok\n");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,111 @@
+// O3SyslogSink with a UDP stub: RFC 5424 framing, batching several lines per datagram, the flush
+// interval, keeping lines while the network is down and dropping the oldest when the backlog is full.
+#include <Arduino.h>
+
+#include <vector>
+
+#include <O3SerialWriter.h>
+#include <O3SyslogSink.h>
+
+// Collects every datagram that endPacket() would send. up = false makes the send fail.
+class FakeUdp {
+public:
+  int beginPacket(const char*, uint16_t) {
+    packet.clear();
+    return 1;
+  }
+  size_t write(uint8_t value) {
+    packet += static_cast<char>(value);
+    return 1;
+  }
+  size_t write(const uint8_t* data, size_t size) {
+    packet.append(reinterpret_cast<const char*>(data), size);
+    return size;
+  }
+  int endPacket() {
+    if (!up) return 0;
+    sent.push_back(packet);
+    return 1;
+  }
+
+  std::string packet;
+  std::vector<std::string> sent;
+  bool up = true;
+};
+
+static int failures = 0;
+
+static void expect(const char* name, bool condition) {
+  if (condition) return;
+  printf("FAIL %s\n", name);
+  failures++;
+}
+
+static void setMillis(uint32_t ms) { hostClockMicros = ms * 1000; }
+
+int main() {
+  FakeUdp udp;
+  O3SyslogSink<FakeUdp, 400, 200> syslog;
+  O3SerialWriter sw;
+
+  O3SyslogSinkOptions syslogOptions;
+  syslogOptions.hostname = "node-07";
+  syslogOptions.appName = "gateway";
+  syslogOptions.flushIntervalMs = 1000;
+  syslogOptions.retryIntervalMs = 5000;
+  syslog.begin(udp, "192.168.1.10", 514, syslogOptions);
+
+  O3SerialWriterOptions options;
+  options.prefix = "NET";
+  options.showMillis = false;
+  options.minLevel = O3LogLevel::None; // Only syslog gets lines
+  sw.begin(Serial, options);
+  expect("addSink", sw.addSink(syslog, O3LogLevel::Debug));
+  expect("flush level", sw.setSinkFlushLevel(syslog, O3LogLevel::Error));
+
+  // Two lines wait for the flush interval and go out in one datagram.
+  setMillis(100);
+  sw.info("Boot");
+  sw.debug("adc", 512);
+  expect("queued", udp.sent.empty() && syslog.queuedBytes() > 0);
+  setMillis(1099);
+  syslog.flushIfDue();
+  expect("not due yet", udp.sent.empty());
+  setMillis(1100);
+  syslog.flushIfDue();
+  expect("one batch", udp.sent.size() == 1);
+  if (udp.sent.size() == 1) {
+    expect("framing", udp.sent[0] ==
+                          "<134>1 - node-07 gateway - - - [NET] INFO: Boot\n"
+                          "<135>1 - node-07 gateway - - - [NET] DEBUG: adc 512");
+  }
+
+  // An error is sent right away.
+  udp.sent.clear();
+  sw.error("boom");
+  expect("error sent", udp.sent.size() == 1 && syslog.queuedBytes() == 0);
+
+  // While the network is down the lines stay queued, the oldest are dropped when it is full.
+  udp.sent.clear();
+  udp.up = false;
+  for (int i = 0; i < 20; i++) sw.warn("retry", i);
+  syslog.flush();
+  expect("kept while down", udp.sent.empty() && syslog.queuedBytes() > 0);
+  expect("oldest dropped", syslog.droppedLines() > 0);
+
+  udp.up = true;
+  setMillis(2000);
+  syslog.flushIfDue();
+  expect("waits for retry", udp.sent.empty());
+  setMillis(20000);
+  syslog.flushIfDue();
+  expect("sent after retry", !udp.sent.empty() && syslog.queuedBytes() == 0);
+  for (const std::string& packet : udp.sent) expect("packet size", packet.size() <= 200);
+  if (!udp.sent.empty()) {
+    const std::string& last = udp.sent.back();
+    expect("newest kept", last.size() >= 8 && last.compare(last.size() - 8, 8, "retry 19") == 0);
+  }
+
+  if (failures == 0) printf("syslog_sink: ok\n");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,61 @@
+// Crash log records keep the tag id. After a "reboot" (a second writer on the same O3PersistentLog)
+// a tag that is registered again prints its name, one that is not prints its number.
+#include <Arduino.h>
+
+#include <O3SerialWriter.h>
+
+class CaptureStream : public Stream {
+public:
+  using Print::write;
+  size_t write(uint8_t value) override { return write(&value, 1); }
+  size_t write(const uint8_t* data, size_t size) override {
+    text.append(reinterpret_cast<const char*>(data), size);
+    return size;
+  }
+
+  std::string text;
+};
+
+static int failures = 0;
+
+static void expectText(const char* name, const std::string& actual, const char* expected) {
+  if (actual == expected) return;
+  printf("FAIL %s\nexpected:\n%s\nactual:\n%s\n", name, expected, actual.c_str());
+  failures++;
+}
+
+static O3PersistentLog crashLog;
+
+int main() {
+  O3SerialWriterOptions options;
+  options.prefix = "APP";
+  options.showMillis = false;
+
+  {
+    CaptureStream out;
+    O3SerialWriter sw;
+    sw.begin(out, options);
+    sw.persistTo(crashLog);
+    O3LogTag mqtt = sw.tag("MQTT");
+    O3LogTag pump = sw.tag("PUMP");
+    mqtt.info("connected");
+    pump.warn("p2");
+    sw.error("plain");
+  }
+
+  // Next boot: only MQTT is registered before the dump.
+  CaptureStream out;
+  O3SerialWriter sw;
+  sw.begin(out, options);
+  sw.persistTo(crashLog);
+  sw.tag("MQTT");
+  sw.dumpPersisted();
+  expectText("replay", out.text,
+             "[MQTT] INFO: connected\r\n"
+             "[#2] WARN: p2\r\n"
+             "[APP] ERROR: plain\r\n"
+             "----- reset -----\r\n");
+
+  if (failures == 0) printf("tag_replay: ok\n");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,81 @@
+// "last message repeated" and "lines suppressed by rate limit" notes in the structured and binary
+// formats: they must come out as a JSON object, a logfmt line or a binary record like every other line.
+#include <Arduino.h>
+
+#include <O3SerialWriter.h>
+
+class CaptureStream : public Stream {
+public:
+  using Print::write;
+  size_t write(uint8_t value) override { return write(&value, 1); }
+  size_t write(const uint8_t* data, size_t size) override {
+    text.append(reinterpret_cast<const char*>(data), size);
+    return size;
+  }
+
+  std::string text;
+};
+
+static int failures = 0;
+
+static void expect(const char* name, bool condition) {
+  if (condition) return;
+  printf("FAIL %s\n", name);
+  failures++;
+}
+
+static bool contains(const std::string& text, const std::string& part) { return text.find(part) != std::string::npos; }
+
+// Five equal warnings, then a different line, then a rate limited burst.
+static std::string run(O3LogFormat format) {
+  CaptureStream out;
+  O3SerialWriter sw;
+  O3SerialWriterOptions options;
+  options.prefix = "NET";
+  options.suppressRepeats = true;
+  options.format = format;
+  sw.begin(out, options);
+  for (int i = 0; i < 5; i++) sw.warn("HTTP", 503);
+  sw.info("other");
+
+  options.suppressRepeats = false;
+  options.rateLimitPerSecond = 1;
+  options.rateLimitBurst = 1;
+  sw.configure(options);
+  for (int i = 0; i < 4; i++) sw.info("tick", i);
+  hostClockMicros += 2000000;
+  sw.info("after");
+  return out.text;
+}
+
+// Every line of the output has to start with start.
+static bool allLinesStartWith(const std::string& text, const char* start) {
+  size_t position = 0;
+  while (position < text.size()) {
+    if (text.compare(position, strlen(start), start) != 0) return false;
+    const size_t end = text.find('\n', position);
+    if (end == std::string::npos) return false;
+    position = end + 1;
+  }
+  return true;
+}
+
+int main() {
+  const std::string json = run(O3LogFormat::Json);
+  expect("json objects only", allLinesStartWith(json, "{"));
+  expect("json repeat note", contains(json, "\"msg\":\"last message repeated 4 times\"}"));
+  expect("json rate note", contains(json, "\"msg\":\"3 lines suppressed by rate limit\"}"));
+
+  const std::string logfmt = run(O3LogFormat::Logfmt);
+  expect("logfmt lines only", allLinesStartWith(logfmt, "ts="));
+  expect("logfmt repeat note", contains(logfmt, "level=WARN prefix=NET msg=\"last message repeated 4 times\""));
+
+  // Binary: the notes are text parts of records (tag 0x01 ... NUL), no text header in between.
+  const std::string binary = run(O3LogFormat::Binary);
+  expect("binary no text header", !contains(binary, "WARN:") && !contains(binary, "INFO:"));
+  expect("binary repeat note", contains(binary, std::string("\x01last message repeated 4 times\0", 31)));
+  expect("binary rate note", contains(binary, std::string("\x01" "3 lines suppressed by rate limit\0", 34)));
+
+  if (failures == 0) printf("throttle_notes: ok\n");
+  return failures == 0 ? 0 : 1;
+}
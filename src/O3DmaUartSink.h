@@ -0,0 +1,185 @@
+#pragma once
+
+#include "O3SerialWriter.h"
+
+#if defined(ARDUINO_ARCH_RP2040)
+#include <hardware/dma.h>
+#include <hardware/uart.h>
+#endif
+
+// UART output that sends with DMA instead of copying into the serial driver byte by byte.
+//
+// HardwareSerial::write copies every byte into a driver buffer, then a TX interrupt moves it to the
+// UART one byte (or one FIFO fill) at a time. O3DmaUartSink collects the bytes in one of two RAM
+// buffers and hands a whole buffer to the DMA controller, which feeds the UART without the CPU.
+// While one buffer is on its way, the next lines are formatted into the other one:
+//   - a write starts a transfer right away if the DMA is idle,
+//   - otherwise the bytes wait in the second buffer until the transfer finished,
+//     the next write, flushIfDue() or availableForWrite() then starts them,
+//   - only a full second buffer while the DMA is still busy makes a write wait.
+// Use it as the main output (or as a sink), together with O3_LOG_LINE_BUFFER_SIZE or async mode
+// so every line arrives in one write:
+//   O3DmaUartSink<O3Rp2040UartDma> uartOut;
+//   Serial1.begin(921600);        // pins and baud rate, the sink takes over sending
+//   uartOut.begin(uart0);
+//   sw.begin(uartOut, options);
+//   // in loop(): uartOut.flushIfDue();
+// Do not print to Serial1 directly while the sink is in use, the bytes would mix.
+//
+// Backend is the board-specific part, a class with
+//   bool busy()                                  a transfer is still running
+//   void start(const uint8_t* data, size_t size) starts a transfer of size bytes (size <= BufferSize)
+//   void waitSent()                              waits until the last byte left the UART
+// and a begin(...) that takes whatever the board needs. O3Rp2040UartDma and O3Stm32UartDma are
+// included. ESP32 cores do not offer UART DMA (it needs the UHCI peripheral), a custom backend
+// built on ESP-IDF plugs in the same way. BufferSize is the size of each of the two buffers.
+template <typename Backend, size_t BufferSize = 256>
+class O3DmaUartSink : public Stream {
+public:
+  O3DmaUartSink() = default;
+  O3DmaUartSink(const O3DmaUartSink&) = delete;
+  O3DmaUartSink& operator=(const O3DmaUartSink&) = delete;
+
+  // Passes its arguments to Backend::begin(). Waits for a running transfer first.
+  template <typename... Args>
+  bool begin(Args&&... args) {
+    flush();
+    return dma.begin(args...);
+  }
+
+  using Print::write;
+
+  size_t write(uint8_t value) override { return write(&value, 1); }
+
+  size_t write(const uint8_t* data, size_t size) override {
+    const size_t total = size;
+    while (size > 0) {
+      if (used == BufferSize) send(); // Waits for the DMA, the only place that blocks
+      size_t chunk = BufferSize - used;
+      if (chunk > size) chunk = size;
+      memcpy(buffers[fill] + used, data, chunk);
+      used += chunk;
+      data += chunk;
+      size -= chunk;
+    }
+    flushIfDue();
+    return total;
+  }
+
+  // Room left before a write has to wait for the DMA. Also starts waiting bytes,
+  // so async mode's pump() keeps the transfers going.
+  int availableForWrite() override {
+    flushIfDue();
+    if (!dma.busy()) return static_cast<int>(2 * BufferSize - used);
+    return static_cast<int>(BufferSize - used);
+  }
+
+  // Starts the waiting bytes if the previous transfer finished. Call it from loop() so the last
+  // lines go out even when nothing else is written.
+  void flushIfDue() {
+    if (used > 0 && !dma.busy()) send();
+  }
+
+  // Sends everything and waits until it left the UART, for example before deep sleep.
+  void flush() override {
+    send();
+    dma.waitSent();
+  }
+
+  // Bytes waiting for the next transfer.
+  size_t pendingBytes() const { return used; }
+
+  Backend& backend() { return dma; }
+
+  // Stream has to be complete so the sink can be passed to O3SerialWriter::begin().
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+
+private:
+  static_assert(BufferSize >= 16 && BufferSize <= 0xFFFF, "BufferSize must be 16..65535");
+
+  Backend dma;
+  uint8_t buffers[2][BufferSize];
+  uint8_t fill = 0; // Buffer the writes go to, the DMA may be reading the other one
+  size_t used = 0;
+
+  // Hands the fill buffer to the DMA and switches to the other one.
+  void send() {
+    if (used == 0) return;
+    while (dma.busy()) {
+    }
+    dma.start(buffers[fill], used);
+    fill ^= 1;
+    used = 0;
+  }
+};
+
+#if defined(ARDUINO_ARCH_RP2040)
+// O3DmaUartSink backend for the RP2040 UARTs: one DMA channel feeds the UART data register,
+// paced by the UART's TX request line. Serial1 is uart0, Serial2 is uart1.
+class O3Rp2040UartDma {
+public:
+  // Call SerialN.begin(baud) before, it sets up the pins and the baud rate.
+  // Returns false if no DMA channel is free.
+  bool begin(uart_inst_t* port) {
+    if (channel < 0) channel = dma_claim_unused_channel(false);
+    if (channel < 0) return false;
+    uart = port;
+    dma_channel_config config = dma_channel_get_default_config(static_cast<uint>(channel));
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_read_increment(&config, true);
+    channel_config_set_write_increment(&config, false);
+    channel_config_set_dreq(&config, uart_get_dreq(port, true));
+    dma_channel_set_config(static_cast<uint>(channel), &config, false);
+    dma_channel_set_write_addr(static_cast<uint>(channel), &uart_get_hw(port)->dr, false);
+    return true;
+  }
+
+  bool busy() const { return channel >= 0 && dma_channel_is_busy(static_cast<uint>(channel)); }
+
+  void start(const uint8_t* data, size_t size) {
+    if (channel < 0) return;
+    dma_channel_transfer_from_buffer_now(static_cast<uint>(channel), data, static_cast<uint32_t>(size));
+  }
+
+  void waitSent() {
+    while (busy()) {
+    }
+    if (uart) uart_tx_wait_blocking(uart);
+  }
+
+private:
+  uart_inst_t* uart = nullptr;
+  int channel = -1;
+};
+#endif
+
+#if defined(ARDUINO_ARCH_STM32) && defined(HAL_UART_MODULE_ENABLED) && defined(HAL_DMA_MODULE_ENABLED)
+// O3DmaUartSink backend for STM32 boards using HAL_UART_Transmit_DMA(). The handle has to be set up
+// by the sketch (CubeMX style): UART initialized, a TX DMA stream linked to it (hdmatx), and the
+// UART and DMA interrupts calling HAL_UART_IRQHandler() and HAL_DMA_IRQHandler().
+class O3Stm32UartDma {
+public:
+  // Returns false if the handle has no TX DMA linked.
+  bool begin(UART_HandleTypeDef& handle) {
+    uart = &handle;
+    return handle.hdmatx != nullptr;
+  }
+
+  // gState is back to ready once the transfer complete interrupt saw the last byte leave.
+  bool busy() const { return uart && uart->gState != HAL_UART_STATE_READY; }
+
+  void start(const uint8_t* data, size_t size) {
+    if (uart) HAL_UART_Transmit_DMA(uart, const_cast<uint8_t*>(data), static_cast<uint16_t>(size));
+  }
+
+  void waitSent() {
+    while (busy()) {
+    }
+  }
+
+private:
+  UART_HandleTypeDef* uart = nullptr;
+};
+#endif
@@ -0,0 +1,209 @@
+#pragma once
+
+#include "O3SerialWriter.h"
+
+// Mode that opens a file for appending (and creates it). FILE_APPEND on ESP32/ESP8266/RP2040
+// filesystems, FILE_WRITE (which appends) in the SD and SdFat libraries. Both are macros of the
+// filesystem library, so include its header (LittleFS.h, SD.h, SdFat.h, ...) before this one.
+#ifndef O3_LOG_FILE_APPEND_MODE
+#if defined(FILE_APPEND)
+#define O3_LOG_FILE_APPEND_MODE FILE_APPEND
+#elif defined(FILE_WRITE)
+#define O3_LOG_FILE_APPEND_MODE FILE_WRITE
+#else
+#error "Include the filesystem header (LittleFS.h, SD.h, SdFat.h, ...) before O3FileSink.h, or define O3_LOG_FILE_APPEND_MODE"
+#endif
+#endif
+
+// Options of an O3FileSink, passed to begin().
+struct O3FileSinkOptions {
+  uint32_t maxFileSize = 64UL * 1024;  // Rotate when the file reaches this size (0 = never rotate)
+  uint8_t maxFiles = 3;                // Files kept, including the current one: log.txt, log.txt.1, log.txt.2
+  uint32_t flushIntervalMs = 5000;     // Write a partial page once its oldest byte is this old (0 = only full pages)
+};
+
+// Log file output for SD cards and flash filesystems (LittleFS, SPIFFS, SdFat).
+//
+// Passing a File straight to begin() or addSink() writes a few bytes per call, which is slow and,
+// on flash, rewrites the same sector again and again. O3FileSink collects the bytes in a RAM page
+// and writes whole, sector-aligned pages. A partial page is written when
+//   - flushIntervalMs passed since its first byte (checked on every write and in flushIfDue()),
+//   - the writer flushes the sink after a line, see O3SerialWriter::setSinkFlushLevel(),
+//   - or flush() is called, for example before deep sleep.
+// The file is rotated at the end of a line once it reached maxFileSize: log.txt becomes log.txt.1,
+// log.txt.1 becomes log.txt.2 and so on, the oldest file is removed.
+//
+//   O3FileSink<fs::FS> logFile;
+//   LittleFS.begin();
+//   logFile.begin(LittleFS, "/log.txt");
+//   sw.addSink(logFile, O3LogLevel::Debug);
+//   sw.setSinkFlushLevel(logFile, O3LogLevel::Error);   // errors reach the file right away
+//
+// FileSystem is the filesystem class (fs::FS, SDFS, SdFat, ...). It needs open(path, mode),
+// exists(), remove() and rename(). PageSize is the RAM buffer, the flash or SD sector size fits best.
+template <typename FileSystem, size_t PageSize = 512>
+class O3FileSink : public Stream {
+public:
+  O3FileSink() = default;
+  O3FileSink(const O3FileSink&) = delete;
+  O3FileSink& operator=(const O3FileSink&) = delete;
+
+  // Opens (or creates) the file and appends to it. Returns false if it cannot be opened,
+  // the sink then retries with every page it writes.
+  bool begin(FileSystem& target, const char* filePath, const O3FileSinkOptions& sinkOptions = O3FileSinkOptions()) {
+    flush();
+    close();
+    fileSystem = &target;
+    options = sinkOptions;
+    size_t i = 0;
+    if (filePath) {
+      for (; i + 1 < pathMaxLen && filePath[i] != '\0'; i++) path[i] = filePath[i];
+    }
+    path[i] = '\0';
+    return open();
+  }
+
+  using Print::write;
+
+  size_t write(uint8_t value) override { return write(&value, 1); }
+
+  size_t write(const uint8_t* data, size_t size) override {
+    const size_t total = size;
+    if (used == 0 && size > 0) pendingSince = millis();
+    while (size > 0) {
+      size_t chunk = pageLimit() - used;
+      if (chunk > size) chunk = size;
+      bool lineEnd = false;
+      if (rotateDue) {
+        // Rotation waits for the end of the line, so no line is split between two files.
+        const void* newline = memchr(data, '\n', chunk);
+        if (newline) {
+          chunk = static_cast<size_t>(static_cast<const uint8_t*>(newline) - data) + 1;
+          lineEnd = true;
+        }
+      }
+      memcpy(page + used, data, chunk);
+      used += chunk;
+      data += chunk;
+      size -= chunk;
+      if (used == pageLimit() || lineEnd) {
+        writePage();
+        if (size > 0) pendingSince = millis();
+      }
+    }
+    flushIfDue();
+    return total;
+  }
+
+  // Bytes that fit before the page is written, lets async mode feed the sink in page-sized steps.
+  int availableForWrite() override { return static_cast<int>(pageLimit() - used); }
+
+  // Writes the page if it is older than flushIntervalMs. Call it from loop() so the last lines
+  // reach the file even when nothing else is logged.
+  void flushIfDue() {
+    if (used > 0 && options.flushIntervalMs > 0 && millis() - pendingSince >= options.flushIntervalMs) flush();
+  }
+
+  // Writes the page and asks the filesystem to commit it (directory entry, file size).
+  void flush() override {
+    writePage();
+    if (file) file.flush();
+  }
+
+  // Flushes and closes the file, for example before removing the card. Writing reopens it.
+  void close() {
+    writePage();
+    if (file) file.close();
+  }
+
+  // Bytes waiting in RAM.
+  size_t pendingBytes() const { return used; }
+
+  // Size of the current file including the page.
+  uint32_t fileSize() const { return writtenSize + used; }
+
+  // Stream has to be complete so the sink can also be passed to O3SerialWriter::begin().
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+
+private:
+  using File = decltype(o3Declval<FileSystem&>().open("", O3_LOG_FILE_APPEND_MODE));
+
+  static_assert(PageSize >= 16, "PageSize is too small");
+  static constexpr size_t pathMaxLen = 32;
+  static constexpr size_t rotatedNameSize = pathMaxLen + 1 + 3; // "log.txt" + ".255"
+
+  FileSystem* fileSystem = nullptr;
+  File file;
+  O3FileSinkOptions options;
+  char path[pathMaxLen] = "";
+  uint32_t writtenSize = 0;  // Bytes already in the file
+  uint32_t pendingSince = 0; // millis() of the first byte in the page
+  bool rotateDue = false;
+  size_t bytesSinceLimit = 0;
+  size_t used = 0;
+  uint8_t page[PageSize];
+
+  bool open() {
+    if (!fileSystem || path[0] == '\0') return false;
+    file = fileSystem->open(path, O3_LOG_FILE_APPEND_MODE);
+    if (!file) return false;
+    writtenSize = static_cast<uint32_t>(file.size());
+    return true;
+  }
+
+  // End of the page so that every write ends on a sector boundary of the file,
+  // also after a partial page was flushed.
+  size_t pageLimit() const { return PageSize - writtenSize % PageSize; }
+
+  void writePage() {
+    if (used == 0) return;
+    if (!file && !open()) {
+      used = 0; // No card or full filesystem, the page is lost
+      return;
+    }
+    const bool lineEnd = page[used - 1] == '\n';
+    const size_t written = file.write(page, used);
+    writtenSize += static_cast<uint32_t>(written);
+    used = 0;
+    // Rotate at the end of a line, or at the latest one page after the limit was reached.
+    if (rotateDue) {
+      bytesSinceLimit += written;
+      if (lineEnd || bytesSinceLimit >= PageSize) rotate();
+    } else if (options.maxFileSize > 0 && writtenSize >= options.maxFileSize) {
+      rotateDue = true;
+      bytesSinceLimit = 0;
+    }
+  }
+
+  void rotatedName(char* target, uint8_t index) const {
+    size_t length = strlen(path);
+    memcpy(target, path, length);
+    target[length++] = '.';
+    length += O3Format::formatUnsigned(target + length, index);
+    target[length] = '\0';
+  }
+
+  // log.txt.(maxFiles - 1) is removed, every other file moves up by one, log.txt starts empty.
+  void rotate() {
+    rotateDue = false;
+    file.close();
+    char from[rotatedNameSize];
+    char to[rotatedNameSize];
+    if (options.maxFiles > 1) {
+      rotatedName(to, options.maxFiles - 1);
+      if (fileSystem->exists(to)) fileSystem->remove(to);
+      for (uint8_t index = options.maxFiles - 1; index > 1; index--) {
+        rotatedName(from, index - 1);
+        rotatedName(to, index);
+        if (fileSystem->exists(from)) fileSystem->rename(from, to);
+      }
+      rotatedName(to, 1);
+      fileSystem->rename(path, to);
+    } else {
+      fileSystem->remove(path);
+    }
+    open();
+  }
+};
@@ -2,6 +2,128 @@
 
 #include <Arduino.h>
 
+// Size in bytes of the line assembly buffer (compile-time, no heap).
+// 0 (default) prints every piece straight to the Stream, like Serial.print chains do.
+// With a size > 0 the header and all parts of a line are collected first and sent with a single
+// out->write(buffer, length) call, which matters for WiFiClient and other packet based streams.
+// Lines longer than the buffer are sent in buffer-sized chunks, nothing is cut off.
+// The buffer lives on the stack only while a log call runs. Define it before including the header:
+//   #define O3_LOG_LINE_BUFFER_SIZE 96
+//   #include <O3SerialWriter.h>
+#ifndef O3_LOG_LINE_BUFFER_SIZE
+#define O3_LOG_LINE_BUFFER_SIZE 0
+#endif
+
+// Size in bytes of the async ring buffer (compile-time, no heap).
+// 0 (default) writes every line to the Stream right away, which blocks while the TX FIFO is full.
+// With a size > 0 log calls only copy the finished line into the ring and return,
+// and pump() (called from loop()) moves as many bytes as the Stream can take without blocking.
+#ifndef O3_LOG_ASYNC_BUFFER_SIZE
+#define O3_LOG_ASYNC_BUFFER_SIZE 0
+#endif
+
+// Maximum number of outputs per writer, including the Stream passed to begin().
+// Extra outputs are added with addSink(), each line is formatted once and written to every
+// output whose level accepts it. Each extra slot costs a pointer plus one byte of RAM.
+#ifndef O3_LOG_MAX_SINKS
+#define O3_LOG_MAX_SINKS 1
+#endif
+
+// Number of module tags a writer can hand out with tag(), 0 (default) compiles them out.
+// Each tag costs a pointer plus three bytes of RAM, its name is not copied.
+#ifndef O3_LOG_MAX_TAGS
+#define O3_LOG_MAX_TAGS 0
+#endif
+
+// Size in bytes of the input line buffer for pollCommands() (compile-time, no heap),
+// 0 (default) compiles the command reader out. Longer input lines are ignored.
+#ifndef O3_LOG_COMMAND_BUFFER_SIZE
+#define O3_LOG_COMMAND_BUFFER_SIZE 0
+#endif
+
+// Set to 0 to compile out O3LogFormat::Binary (saves flash, every parts(...) call gets smaller).
+#ifndef O3_LOG_BINARY_FORMAT
+#define O3_LOG_BINARY_FORMAT 1
+#endif
+
+// Set to 0 to compile out O3LogFormat::Json and O3LogFormat::Logfmt.
+#ifndef O3_LOG_STRUCTURED_FORMAT
+#define O3_LOG_STRUCTURED_FORMAT 1
+#endif
+
+// Compile-time level floor: 0 = Debug (default, nothing stripped), 1 = Info, 2 = Warn, 3 = Error, 255 = None.
+// debug()/info()/... below the floor compile to empty functions, so no parts<...> template gets
+// instantiated for them. To also skip evaluating the arguments (and keep their string literals out
+// of flash), use the O3_LOG_DEBUG(sw, ...) style macros at the end of this file.
+// The runtime minLevel still filters everything above the floor.
+#ifndef O3_LOG_COMPILE_MIN_LEVEL
+#define O3_LOG_COMPILE_MIN_LEVEL 0
+#endif
+
+// Set to 1 when several FreeRTOS tasks (or both cores of an ESP32/RP2040) log through the same writer.
+// Every task formats its line in its own stack buffer, then a short mutex section writes the
+// finished line in one piece, so lines never interleave mid-line. Needs O3_LOG_LINE_BUFFER_SIZE > 0.
+// Lines longer than the buffer hold the mutex from their first full buffer until their newline.
+// In this mode log calls must not be made from an ISR.
+#ifndef O3_LOG_THREAD_SAFE
+#define O3_LOG_THREAD_SAFE 0
+#endif
+
+// Set to 1 to count what logging costs: lines, bytes, time spent inside the outputs' write()
+// (see stats() and printStats()). 0 (default) compiles the counters and the micros() calls out.
+#ifndef O3_LOG_STATS
+#define O3_LOG_STATS 0
+#endif
+
+// Set to 0 to compile out rate limiting and repeat suppression (options.rateLimitPerSecond,
+// options.suppressRepeats). Both are off at run time unless the options enable them.
+#ifndef O3_LOG_RATE_LIMIT
+#define O3_LOG_RATE_LIMIT 1
+#endif
+
+// Size in bytes of the crash log ring (compile-time, no heap), 0 (default) compiles it out, max 65535.
+// With a size > 0, persistTo() makes debug()/info()/... also store each line as a compact binary
+// record in an O3PersistentLog that survives a reset, dumpPersisted() prints them after the next boot.
+#ifndef O3_LOG_PERSIST_BUFFER_SIZE
+#define O3_LOG_PERSIST_BUFFER_SIZE 0
+#endif
+
+// Size in bytes of the pre-trigger backlog (compile-time, no heap), 0 (default) compiles it out, max 65535.
+// With a size > 0, setBacklogTrigger() keeps lines below a level as compact records in RAM instead
+// of writing them, and writes them (oldest first) right before the next line at that level or above.
+#ifndef O3_LOG_BACKLOG_BUFFER_SIZE
+#define O3_LOG_BACKLOG_BUFFER_SIZE 0
+#endif
+
+// Attribute for the O3PersistentLog global: keeps it out of the startup code's zeroing, so it survives
+// a watchdog or software reset. RTC memory on ESP32, uninitialized RAM on RP2040 and AVR. On other
+// boards define it before the include, for example as __attribute__((section(".noinit"))) if the
+// linker script has that section. Without one the log only survives until the next boot.
+#ifndef O3_LOG_NOINIT
+#if defined(ARDUINO_ARCH_ESP32)
+#define O3_LOG_NOINIT RTC_NOINIT_ATTR
+#elif defined(ARDUINO_ARCH_RP2040)
+#define O3_LOG_NOINIT __attribute__((section(".uninitialized_data.o3log")))
+#elif defined(__AVR__)
+#define O3_LOG_NOINIT __attribute__((section(".noinit")))
+#else
+#define O3_LOG_NOINIT
+#endif
+#endif
+
+#if O3_LOG_THREAD_SAFE
+#if defined(ARDUINO_ARCH_RP2040)
+#include <pico/mutex.h>
+#elif defined(ARDUINO_ARCH_ESP32)
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#elif defined(INC_FREERTOS_H)
+#include <semphr.h>
+#else
+#error "O3_LOG_THREAD_SAFE needs an ESP32, an RP2040 or FreeRTOS included before O3SerialWriter.h"
+#endif
+#endif
+
 // Log levels, ordered from least important to most important.
 // minLevel works like a filter, for example if minLevel = Warn, then Debug and Info are skipped.
 enum class O3LogLevel : uint8_t {
@@ -12,17 +134,555 @@ enum class O3LogLevel : uint8_t {
   None  = 255
 };
 
+// True if log calls at this level survive the O3_LOG_COMPILE_MIN_LEVEL floor.
+constexpr bool o3LogLevelCompiledIn(O3LogLevel level) {
+#if O3_LOG_COMPILE_MIN_LEVEL <= 0
+  return level != O3LogLevel::None;
+#else
+  return level != O3LogLevel::None && static_cast<uint8_t>(level) >= O3_LOG_COMPILE_MIN_LEVEL;
+#endif
+}
+
+// What async mode does when a new line does not fit into the ring buffer.
+enum class O3OverflowPolicy : uint8_t {
+  DropNewest = 0, // Discard the new line (default, never blocks)
+  DropOldest = 1, // Discard queued lines that were not sent yet to make room
+  Block      = 2  // Wait and send queued bytes until there is room (behaves like synchronous output)
+};
+
+// What the timestamp column shows (options.timestamp). Resolved once in configure(),
+// each line then costs one function pointer call.
+enum class O3TimestampSource : uint8_t {
+  Millis      = 0, // millis() since boot (default)
+  Micros      = 1, // micros() since boot, for profiling bursts (wraps after about 71 minutes)
+  DeltaMillis = 2, // Milliseconds since the previous line, short numbers save bandwidth
+  DeltaMicros = 3, // Microseconds since the previous line
+  Epoch       = 4  // Unix time with milliseconds, "1700000000.123", see options.epochSource
+};
+
+// Output format of debug()/info()/warn()/error().
+// Binary writes compact tokenized records instead of text (see "Binary records" below),
+// extras/decoder/o3log_decode.py turns them back into the usual text lines on the host.
+// Json writes one JSON object per line, Logfmt writes key=value pairs, both for log collectors:
+//   {"ts":12345,"level":"INFO","prefix":"NET","msg":"Backoff","backoff":250}
+//   ts=12345 level=INFO prefix=NET msg="Backoff" backoff=250
+// drawLine(), printOptions() and the print()/println() chain always write text.
+enum class O3LogFormat : uint8_t {
+  Text   = 0,
+  Binary = 1,
+  Json   = 2,
+  Logfmt = 3
+};
+
+// A named part, created with O3SerialWriter::kv(). Text output prints it as key=value,
+// Json and Logfmt output turn it into its own field.
+template <typename Key, typename Value>
+struct O3KeyValue {
+  Key key;
+  const Value& value;
+};
+
+// Float part with its own number of decimals, created with O3SerialWriter::fixed().
+template <typename T>
+struct O3Fixed {
+  T value;
+  uint8_t decimals;
+};
+
+// Text given by pointer and length, created with O3SerialWriter::span(). It needs no terminating
+// NUL, so a slice of a larger buffer is logged without copying it first.
+struct O3Span {
+  const char* data;
+  size_t length;
+};
+
+template <typename T>
+struct O3IsKeyValue {
+  static constexpr bool value = false;
+};
+
+template <typename Key, typename Value>
+struct O3IsKeyValue<O3KeyValue<Key, Value>> {
+  static constexpr bool value = true;
+};
+
+// Only used in decltype, like std::declval (AVR has no <utility>).
+template <typename T>
+T&& o3Declval() noexcept;
+
+// True for classes derived from Printable, like std::is_base_of (AVR has no <type_traits>).
+template <typename T>
+struct O3IsPrintable {
+  static char test(const Printable*);
+  static long test(...);
+  static constexpr bool value = sizeof(test(static_cast<const T*>(nullptr))) == sizeof(char);
+};
+
+// True for lambdas and functions that take no arguments and return a printable value.
+// Such parts are called only after the level check passed, so expensive values cost nothing
+// when the line is filtered out:
+//   sw.debug("rssi", [] { return WiFi.RSSI(); });
+template <typename T, typename = void>
+struct O3IsLazyPart {
+  static constexpr bool value = false;
+};
+
+template <typename T>
+struct O3IsLazyPart<T, decltype(void(o3Declval<const T&>()()))> {
+  static constexpr bool value = true;
+};
+
+// True for lazy parts and for kv() parts with a lazy value.
+template <typename T>
+struct O3HasLazyValue {
+  static constexpr bool value = O3IsLazyPart<T>::value;
+};
+
+template <typename Key, typename Value>
+struct O3HasLazyValue<O3KeyValue<Key, Value>> {
+  static constexpr bool value = O3IsLazyPart<Value>::value;
+};
+
+// What a printf conversion may be applied to: 'i' integer, 'c' char, 'f' floating point,
+// 's' text, 'l' lazy part (decided when it is called), 'o' anything else (printed with %s).
+template <typename T>
+struct O3FormatKind {
+  static constexpr char value = O3IsLazyPart<T>::value ? 'l' : 'o';
+};
+
+template <> struct O3FormatKind<bool>                       { static constexpr char value = 'i'; };
+template <> struct O3FormatKind<char>                       { static constexpr char value = 'c'; };
+template <> struct O3FormatKind<signed char>                { static constexpr char value = 'i'; };
+template <> struct O3FormatKind<unsigned char>              { static constexpr char value = 'i'; };
+template <> struct O3FormatKind<short>                      { static constexpr char value = 'i'; };
+template <> struct O3FormatKind<unsigned short>             { static constexpr char value = 'i'; };
+template <> struct O3FormatKind<int>                        { static constexpr char value = 'i'; };
+template <> struct O3FormatKind<unsigned int>               { static constexpr char value = 'i'; };
+template <> struct O3FormatKind<long>                       { static constexpr char value = 'i'; };
+template <> struct O3FormatKind<unsigned long>              { static constexpr char value = 'i'; };
+template <> struct O3FormatKind<long long>                  { static constexpr char value = 'i'; };
+template <> struct O3FormatKind<unsigned long long>         { static constexpr char value = 'i'; };
+template <> struct O3FormatKind<float>                      { static constexpr char value = 'f'; };
+template <> struct O3FormatKind<double>                     { static constexpr char value = 'f'; };
+template <> struct O3FormatKind<const char*>                { static constexpr char value = 's'; };
+template <> struct O3FormatKind<char*>                      { static constexpr char value = 's'; };
+template <> struct O3FormatKind<const __FlashStringHelper*> { static constexpr char value = 's'; };
+template <> struct O3FormatKind<String>                     { static constexpr char value = 's'; };
+template <> struct O3FormatKind<O3Span>                     { static constexpr char value = 's'; };
+template <size_t N> struct O3FormatKind<char[N]>            { static constexpr char value = 's'; };
+template <typename T> struct O3FormatKind<O3Fixed<T>>       { static constexpr char value = 'f'; };
+
+// Unsigned type that integers are formatted in, 64-bit math only where the argument needs it.
+template <bool Wide> struct O3FormatBits       { using type = uint32_t; };
+template <>          struct O3FormatBits<true> { using type = uint64_t; };
+
+constexpr bool o3FormatDigit(char c) { return c >= '0' && c <= '9'; }
+
+// Whether conversion fits an argument of the given kind.
+constexpr bool o3FormatAccepts(char conversion, char kind) {
+  if (kind == 'l') return conversion != '\0';
+  switch (conversion) {
+    case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+      return kind == 'i' || kind == 'c';
+    case 'f': case 'F':
+      return kind == 'f';
+    case 's':
+      return kind == 's' || kind == 'o';
+    default:
+      return false;
+  }
+}
+
+// Compile-time check of an O3_FMT() format string: as many conversions as arguments, each one
+// supported and matching its argument. Flags, width, precision and length modifiers are skipped.
+template <typename... Args>
+constexpr bool o3FormatMatches(const char* format) {
+  constexpr char kinds[] = { O3FormatKind<Args>::value..., '\0' };
+  size_t argument = 0;
+  const char* p = format;
+  while (*p != '\0') {
+    if (*p++ != '%') continue;
+    if (*p == '%') {
+      p++;
+      continue;
+    }
+    while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0') p++;
+    while (o3FormatDigit(*p)) p++;
+    if (*p == '.') {
+      p++;
+      while (o3FormatDigit(*p)) p++;
+    }
+    while (*p == 'h' || *p == 'l' || *p == 'z' || *p == 'j' || *p == 't' || *p == 'L') p++;
+    if (argument >= sizeof...(Args) || !o3FormatAccepts(*p, kinds[argument])) return false;
+    argument++;
+    p++;
+  }
+  return argument == sizeof...(Args);
+}
+
+// Format string whose text is known at compile time, created with O3_FMT("...").
+template <typename Text>
+struct O3FormatString {};
+
+// sw.infof(O3_FMT("%-8s %5d ms"), name, elapsed) checks the format against the argument types
+// at compile time. The text stays in RAM, on AVR an F("...") format (checked at run time) saves it.
+#define O3_FMT(text) ([] { \
+    struct O3FormatText { static constexpr const char* value() { return text; } }; \
+    return O3FormatString<O3FormatText>(); \
+  }())
+
+// Binary records (O3LogFormat::Binary):
+//   0xA5, level, varint timestamp, varint callsite id, parts..., 0x00
+// Every part starts with a tag byte:
+//   0x01 text, NUL terminated        0x02 signed integer, zigzag varint
+//   0x03 unsigned integer, varint    0x04 float, 4 bytes little-endian
+//   0x05 double, 8 bytes LE          0x06 char, 1 byte
+//   0x07 bool, 1 byte                0x08 key of a kv() part, NUL terminated, the value part follows
+//   0x09 fixed(), 1 byte decimals, the float/double part follows
+// configure(), setPrefix() and setPartSeparator() emit a settings record so the decoder can
+// rebuild the header: 0xA6, prefix, 0x00, partSeparator, 0x00, flags (bit0 showMillis, bit1 showLevel,
+// bits 2..4 O3TimestampSource, bit5 millisWidth follows). With O3TimestampSource::Epoch a varint with
+// the epoch seconds follows, and the record timestamps count milliseconds since that second. Then, if
+// bit5 is set, one byte with millisWidth (only sent when it is not 0).
+// Varints are LEB128 (7 bits per byte, low bits first). Text lines may appear between records.
+static constexpr uint8_t O3RecordStart = 0xA5;
+static constexpr uint8_t O3SettingsStart = 0xA6;
+
+// Stable 16-bit id for a source location, used as callsite id by the O3_LOG_* macros.
+constexpr uint32_t o3Fnv1a(const char* text, uint32_t hash = 2166136261u) {
+  return *text ? o3Fnv1a(text + 1, (hash ^ static_cast<uint8_t>(*text)) * 16777619u) : hash;
+}
+
+constexpr uint16_t o3CallsiteId(const char* file, uint32_t line) {
+  return static_cast<uint16_t>((o3Fnv1a(file) ^ (line * 2654435761u)) >> 16);
+}
+
+// Forces the id to be computed at compile time when passed as a function argument.
+template <uint16_t Id>
+struct O3CallsiteIdConstant {
+  static constexpr uint16_t value = Id;
+};
+
+#define O3_LOG_CALLSITE_ID (O3CallsiteIdConstant<o3CallsiteId(__FILE__, __LINE__)>::value)
+
+// Integer to text conversion used for timestamps and integer parts.
+// Print::print(long) emits one digit per division and one write() per digit. These helpers
+// take two digits per division (from a 200 byte table in flash), switch to cheap 16-bit
+// divisions on 8-bit MCUs once the value fits, and fill a caller-provided buffer that is then
+// written in one block. All functions return the number of characters written, no terminator.
+struct O3Format {
+  static constexpr size_t maxUnsignedDigits = 10; // uint32_t
+  static constexpr size_t maxSignedChars = 11;    // "-2147483648"
+  static constexpr size_t maxUnsigned64Digits = 20;
+  static constexpr size_t maxSigned64Chars = 20;  // "-9223372036854775808"
+  static constexpr uint8_t maxFixedDecimals = 9;
+  static constexpr size_t maxFixedChars = 1 + maxUnsignedDigits + 1 + maxFixedDecimals;
+
+  static size_t formatUnsigned(char* target, uint32_t value) {
+    char digits[maxUnsignedDigits];
+    char* end = digits + sizeof(digits);
+    char* p = end;
+    while (value > 0xFFFFu) {
+      const uint32_t quotient = value / 100;
+      p = putTwoDigits(p, static_cast<uint8_t>(value - quotient * 100));
+      value = quotient;
+    }
+    uint16_t small = static_cast<uint16_t>(value);
+    while (small >= 100) {
+      const uint16_t quotient = small / 100;
+      p = putTwoDigits(p, static_cast<uint8_t>(small - quotient * 100));
+      small = quotient;
+    }
+    if (small >= 10) {
+      p = putTwoDigits(p, static_cast<uint8_t>(small));
+    } else {
+      *--p = static_cast<char>('0' + small);
+    }
+    const size_t count = static_cast<size_t>(end - p);
+    memcpy(target, p, count);
+    return count;
+  }
+
+  static size_t formatSigned(char* target, int32_t value) {
+    if (value >= 0) return formatUnsigned(target, static_cast<uint32_t>(value));
+    target[0] = '-';
+    // Negate in unsigned arithmetic so INT32_MIN works too.
+    return 1 + formatUnsigned(target + 1, 0u - static_cast<uint32_t>(value));
+  }
+
+  static size_t formatUnsigned64(char* target, uint64_t value) {
+    if (value <= 0xFFFFFFFFull) return formatUnsigned(target, static_cast<uint32_t>(value));
+    // Split off the low 9 digits, they are printed zero-padded after the high part.
+    const uint64_t high = value / 1000000000u;
+    const uint32_t low = static_cast<uint32_t>(value - high * 1000000000u);
+    const size_t count = formatUnsigned64(target, high);
+    return count + formatUnsignedPadded(target + count, low, 9);
+  }
+
+  static size_t formatSigned64(char* target, int64_t value) {
+    if (value >= 0) return formatUnsigned64(target, static_cast<uint64_t>(value));
+    target[0] = '-';
+    return 1 + formatUnsigned64(target + 1, 0u - static_cast<uint64_t>(value));
+  }
+
+  // Zero-padded to at least width characters (width up to maxUnsignedDigits).
+  static size_t formatUnsignedPadded(char* target, uint32_t value, uint8_t width) {
+    char digits[maxUnsignedDigits];
+    const size_t count = formatUnsigned(digits, value);
+    if (width > maxUnsignedDigits) width = maxUnsignedDigits;
+    size_t padding = width > count ? width - count : 0;
+    memset(target, '0', padding);
+    memcpy(target + padding, digits, count);
+    return padding + count;
+  }
+
+  // value with a fixed number of decimals (up to maxFixedDecimals), rounded half up.
+  // Print's digit loop accumulates rounding errors, so at exact ties (75.75 with 1 decimal) or
+  // beyond the precision of the type the last digit can differ from Serial.print().
+  // Uses integer math for the digits: the whole part as uint32_t, the fraction scaled by 10^decimals.
+  // Instantiated for the type of the value, so float stays in single precision (fast on the ESP32 FPU).
+  // nan, inf and values beyond +-4294967040 print as "nan", "inf" and "ovf", same as Print.
+  template <typename T>
+  static size_t formatFixed(char* target, T value, uint8_t decimals) {
+    if (isnan(value)) return copyText(target, "nan");
+    if (isinf(value)) return copyText(target, "inf");
+    if (value > static_cast<T>(4294967040.0) || value < static_cast<T>(-4294967040.0)) return copyText(target, "ovf");
+    size_t length = 0;
+    if (value < 0) {
+      target[length++] = '-';
+      value = -value;
+    }
+    if (decimals > maxFixedDecimals) decimals = maxFixedDecimals;
+    uint32_t scale = 1;
+    for (uint8_t i = 0; i < decimals; i++) scale *= 10;
+    uint32_t whole = static_cast<uint32_t>(value);
+    uint32_t fraction = static_cast<uint32_t>((value - static_cast<T>(whole)) * static_cast<T>(scale) + static_cast<T>(0.5));
+    if (fraction >= scale) {
+      whole++;
+      fraction -= scale;
+    }
+    length += formatUnsigned(target + length, whole);
+    if (decimals > 0) {
+      target[length++] = '.';
+      length += formatUnsignedPadded(target + length, fraction, decimals);
+    }
+    return length;
+  }
+
+  // Lowercase hex digit of a nibble (0..15), from a 16 byte table.
+  static char hexDigit(uint8_t nibble) {
+    static const char digits[16] PROGMEM = { '0','1','2','3','4','5','6','7','8','9','a','b','c','d','e','f' };
+    return static_cast<char>(pgm_read_byte(digits + nibble));
+  }
+
+  // Two hex digits, no prefix.
+  static void formatHexByte(char* target, uint8_t value) {
+    target[0] = hexDigit(value >> 4);
+    target[1] = hexDigit(value & 0x0F);
+  }
+
+private:
+  static size_t copyText(char* target, const char* text) {
+    const size_t length = strlen(text);
+    memcpy(target, text, length);
+    return length;
+  }
+
+  // Writes the two digits of value (0..99) in front of p and returns the new start.
+  static char* putTwoDigits(char* p, uint8_t value) {
+    static const char pairs[200] PROGMEM = {
+      '0','0','0','1','0','2','0','3','0','4','0','5','0','6','0','7','0','8','0','9',
+      '1','0','1','1','1','2','1','3','1','4','1','5','1','6','1','7','1','8','1','9',
+      '2','0','2','1','2','2','2','3','2','4','2','5','2','6','2','7','2','8','2','9',
+      '3','0','3','1','3','2','3','3','3','4','3','5','3','6','3','7','3','8','3','9',
+      '4','0','4','1','4','2','4','3','4','4','4','5','4','6','4','7','4','8','4','9',
+      '5','0','5','1','5','2','5','3','5','4','5','5','5','6','5','7','5','8','5','9',
+      '6','0','6','1','6','2','6','3','6','4','6','5','6','6','6','7','6','8','6','9',
+      '7','0','7','1','7','2','7','3','7','4','7','5','7','6','7','7','7','8','7','9',
+      '8','0','8','1','8','2','8','3','8','4','8','5','8','6','8','7','8','8','8','9',
+      '9','0','9','1','9','2','9','3','9','4','9','5','9','6','9','7','9','8','9','9'
+    };
+    p -= 2;
+    memcpy_P(p, pairs + value * 2, 2);
+    return p;
+  }
+};
+
+#if O3_LOG_THREAD_SAFE
+// The lock behind O3_LOG_THREAD_SAFE. Statically allocated, works across cores.
+class O3LogMutex {
+public:
+#if defined(ARDUINO_ARCH_RP2040)
+  O3LogMutex() { mutex_init(&mutex); }
+  void lock() { mutex_enter_blocking(&mutex); }
+  void unlock() { mutex_exit(&mutex); }
+
+private:
+  mutex_t mutex;
+#else
+  O3LogMutex() : handle(xSemaphoreCreateMutexStatic(&storage)) {}
+  void lock() { xSemaphoreTake(handle, portMAX_DELAY); }
+  void unlock() { xSemaphoreGive(handle); }
+
+private:
+  StaticSemaphore_t storage;
+  SemaphoreHandle_t handle;
+#endif
+};
+#endif
+
+// Counters returned by stats() when O3_LOG_STATS is 1. Times are in microseconds.
+struct O3LogStats {
+  uint32_t linesWritten = 0;      // Lines (and binary records) that reached the outputs
+  uint32_t linesFiltered = 0;     // Calls rejected by the level filter or setEnabled(false)
+  uint32_t bytesWritten = 0;      // Bytes accepted by the first output of each line
+  uint32_t writeMicros = 0;       // Total time spent inside the outputs' write()
+  uint32_t longestLineMicros = 0; // Longest write() time of a single line
+  uint32_t asyncHighWater = 0;    // Most bytes the async ring buffer ever held
+  uint32_t droppedLines = 0;      // Same as droppedLines()
+  uint32_t suppressedLines = 0;   // Same as suppressedLines()
+};
+
+// Memory of the crash log (O3_LOG_PERSIST_BUFFER_SIZE > 0), declared once as a global:
+//   O3_LOG_NOINIT O3PersistentLog crashLog;
+// It has no constructor and no default values on purpose, those would wipe it at every boot.
+// persistTo() checks it and starts empty when it holds random bits (after power-on).
+struct O3PersistentLog {
+  uint32_t magic;
+  volatile uint32_t position; // End of the newest record | start of the oldest << 16, updated in one store
+  uint8_t bytes[O3_LOG_PERSIST_BUFFER_SIZE > 0 ? O3_LOG_PERSIST_BUFFER_SIZE : 1];
+};
+
+// Output that needs to know where lines start and end, and their level (O3SyslogSink frames each
+// line as one syslog message). Register it with addSink() like any other output: the writer calls
+// beginLine() before the first byte of a line and endLine() after its last byte.
+class O3LineSink : public Print {
+public:
+  virtual void beginLine(O3LogLevel level) = 0;
+  virtual void endLine() = 0;
+};
+
 // Configuration options passed once during setup, you can also reconfigure later.
 struct O3SerialWriterOptions {
   const char* prefix = "";                 // Printed at the beginning of every log line, for example "NET"
   bool showMillis = true;                  // If true, prints millis() in each line
+  uint8_t millisWidth = 0;                 // Zero-pad millis to this many digits (0 = no padding, max 10)
   bool showLevel = true;                   // If true, prints INFO/WARN/...
-  O3LogLevel minLevel = O3LogLevel::Debug; // Minimum level to print
+  O3LogLevel minLevel = O3LogLevel::Debug; // Minimum level to print (on the Stream passed to begin())
   const char* partSeparator = " ";         // Separator between parts in variadic logs
   size_t lineLength = 40;                  // Default length for drawLine()
   char lineCharacter = '-';                // Default character for drawLine()
+  O3OverflowPolicy overflowPolicy = O3OverflowPolicy::DropNewest; // Only used with O3_LOG_ASYNC_BUFFER_SIZE > 0
+  O3LogFormat format = O3LogFormat::Text;  // Text lines or compact binary records
+  uint16_t rateLimitPerSecond = 0;         // Lines per second and level for debug()/info()/... (0 = unlimited)
+  uint8_t rateLimitBurst = 10;             // Lines a level may send at once before the rate limit applies
+  bool suppressRepeats = false;            // Collapse identical lines into "last message repeated N times"
+  O3TimestampSource timestamp = O3TimestampSource::Millis; // What showMillis prints
+  uint32_t (*epochSource)() = nullptr;     // Unix seconds from an RTC or NTP, read by configure() and syncEpoch()
+};
+
+// Writer settings in the form the writer keeps them: prefix and separator already rendered,
+// defaults filled in. O3SerialWriter::snapshot() returns the current settings, restore() applies
+// a profile with a few copies, so switching profiles parses no strings. A profile built from
+// constexpr options is rendered at compile time:
+//   constexpr O3SerialWriterOptions diagnosticOptions = [] {
+//     O3SerialWriterOptions o;
+//     o.prefix = "NET";
+//     o.minLevel = O3LogLevel::Debug;
+//     return o;
+//   }();
+//   constexpr O3LogProfile diagnostic(diagnosticOptions);
+//   sw.restore(diagnostic);
+struct O3LogProfile {
+  static constexpr size_t prefixMaxLen = 32;
+  static constexpr size_t partSepMaxLen = 8;
+  static constexpr size_t defaultLineLength = 40;
+  static constexpr char defaultLineCharacter = '-';
+
+  constexpr O3LogProfile() = default;
+
+  constexpr explicit O3LogProfile(const O3SerialWriterOptions& options)
+      : showMillis(options.showMillis),
+        millisWidth(options.millisWidth),
+        showLevel(options.showLevel),
+        minLevel(options.minLevel),
+        lineLength(options.lineLength > 0 ? options.lineLength : defaultLineLength),
+        lineCharacter(options.lineCharacter != '\0' ? options.lineCharacter : defaultLineCharacter),
+        overflowPolicy(options.overflowPolicy),
+        format(options.format),
+        rateLimitPerSecond(options.rateLimitPerSecond),
+        rateLimitBurst(options.rateLimitBurst > 0 ? options.rateLimitBurst : 1),
+        suppressRepeats(options.suppressRepeats),
+        timestamp(options.timestamp),
+        epochSource(options.epochSource) {
+    prefixLength = renderPrefix(prefix, options.prefix);
+    renderSeparator(partSeparator, options.partSeparator);
+  }
+
+  // "NET" becomes "[NET] " in target (prefixMaxLen + 3 bytes), an empty name an empty string.
+  // Returns the length of the name, at most prefixMaxLen - 1.
+  static constexpr uint8_t renderPrefix(char* target, const char* name) {
+    size_t length = 0;
+    if (name) {
+      for (; length + 1 < prefixMaxLen && name[length] != '\0'; length++) target[length + 1] = name[length];
+    }
+    wrapPrefix(target, length);
+    return static_cast<uint8_t>(length);
+  }
+
+  // Adds the brackets around a name of length characters that is already at target + 1.
+  static constexpr void wrapPrefix(char* target, size_t length) {
+    if (length == 0) {
+      target[0] = '\0';
+      return;
+    }
+    target[0] = '[';
+    target[length + 1] = ']';
+    target[length + 2] = ' ';
+    target[length + 3] = '\0';
+  }
+
+  // Copies the separator (at most partSepMaxLen - 1 characters), an empty one becomes " ".
+  static constexpr void renderSeparator(char* target, const char* value) {
+    if (!value || value[0] == '\0') value = " ";
+    size_t i = 0;
+    for (; i + 1 < partSepMaxLen && value[i] != '\0'; i++) target[i] = value[i];
+    target[i] = '\0';
+  }
+
+  char prefix[prefixMaxLen + 3] = {};
+  uint8_t prefixLength = 0;
+  char partSeparator[partSepMaxLen] = { ' ' };
+  bool showMillis = true;
+  uint8_t millisWidth = 0;
+  bool showLevel = true;
+  O3LogLevel minLevel = O3LogLevel::Debug;
+  size_t lineLength = defaultLineLength;
+  char lineCharacter = defaultLineCharacter;
+  O3OverflowPolicy overflowPolicy = O3OverflowPolicy::DropNewest;
+  O3LogFormat format = O3LogFormat::Text;
+  uint16_t rateLimitPerSecond = 0;
+  uint8_t rateLimitBurst = 10;
+  bool suppressRepeats = false;
+  O3TimestampSource timestamp = O3TimestampSource::Millis;
+  uint32_t (*epochSource)() = nullptr;
+
+  // Only filled by snapshot(): the levels of the outputs and tags registered at that time,
+  // a profile made from options leaves them alone in restore().
+  bool hasOutputLevels = false;
+  O3LogLevel outFlushLevel = O3LogLevel::None;
+#if O3_LOG_MAX_SINKS > 1
+  const Print* sinks[O3_LOG_MAX_SINKS - 1] = {};
+  O3LogLevel sinkMinLevels[O3_LOG_MAX_SINKS - 1] = {};
+  O3LogLevel sinkFlushLevels[O3_LOG_MAX_SINKS - 1] = {};
+#endif
+#if O3_LOG_MAX_TAGS > 0
+  O3LogLevel tagMinLevels[O3_LOG_MAX_TAGS] = {};
+#endif
 };
 
+class O3LogTag;
+
 class O3SerialWriter {
 public:
   O3SerialWriter() = default;
@@ -36,6 +696,7 @@ public:
 
   // Generic begin: lets you log to any Stream (Serial, Serial1, WiFiClient, etc.).
   void begin(Stream& stream, const O3SerialWriterOptions& options = O3SerialWriterOptions()) {
+    if (&stream != out) outFlushLevel = O3LogLevel::None;
     out = &stream;
     configure(options);
   }
@@ -45,17 +706,126 @@ public:
     copyPrefix(options.prefix);
     copyPartSeparator(options.partSeparator);
     showMillis = options.showMillis;
+    millisWidth = options.millisWidth;
     showLevel = options.showLevel;
     minLevel = options.minLevel;
+    updateLowestLevel();
     lineLength = options.lineLength > 0 ? options.lineLength : defaultLineLength;
     lineCharacter = options.lineCharacter != '\0' ? options.lineCharacter : defaultLineCharacter;
+    overflowPolicy = options.overflowPolicy;
+    format = options.format;
+    configureTimestamp(options.timestamp, options.epochSource);
+    configureThrottle(options);
+    resetLineState();
+    writeSettingsRecord();
+  }
+
+  // Current settings (everything configure() sets, plus the levels of the extra outputs and tags),
+  // to switch back to them later with restore().
+  O3LogProfile snapshot() const {
+    O3LogProfile profile;
+    memcpy(profile.prefix, prefixBuffer, sizeof(profile.prefix));
+    profile.prefixLength = prefixLength;
+    memcpy(profile.partSeparator, partSeparatorBuffer, sizeof(profile.partSeparator));
+    profile.showMillis = showMillis;
+    profile.millisWidth = millisWidth;
+    profile.showLevel = showLevel;
+    profile.minLevel = minLevel;
+    profile.lineLength = lineLength;
+    profile.lineCharacter = lineCharacter;
+    profile.overflowPolicy = overflowPolicy;
+    profile.format = format;
+#if O3_LOG_RATE_LIMIT
+    profile.rateLimitPerSecond = rateLimitPerSecond;
+    profile.rateLimitBurst = rateLimitBurst;
+    profile.suppressRepeats = suppressRepeats;
+#endif
+    profile.timestamp = timestampSource;
+    profile.epochSource = epochSource;
+    profile.hasOutputLevels = true;
+    profile.outFlushLevel = outFlushLevel;
+#if O3_LOG_MAX_SINKS > 1
+    for (size_t i = 0; i < extraSinkCount; i++) {
+      profile.sinks[i] = extraSinks[i].stream;
+      profile.sinkMinLevels[i] = extraSinks[i].minLevel;
+      profile.sinkFlushLevels[i] = extraSinks[i].flushLevel;
+    }
+#endif
+#if O3_LOG_MAX_TAGS > 0
+    for (size_t i = 0; i < tagCount; i++) profile.tagMinLevels[i] = tags[i].minLevel;
+#endif
+    return profile;
+  }
+
+  // Applies a profile from snapshot() or a constexpr preset. Ends up like configure() with the
+  // options the profile was made from, but copies the pre-rendered prefix and separator instead
+  // of parsing them. The rate limit budget is only refilled and the epoch source only read when
+  // those settings change. A snapshot also brings back the levels of the outputs that are still
+  // registered and of the tags, a preset keeps them as they are.
+  void restore(const O3LogProfile& profile) {
+    memcpy(prefixBuffer, profile.prefix, sizeof(prefixBuffer));
+    prefixLength = profile.prefixLength;
+    memcpy(partSeparatorBuffer, profile.partSeparator, sizeof(partSeparatorBuffer));
+    showMillis = profile.showMillis;
+    millisWidth = profile.millisWidth;
+    showLevel = profile.showLevel;
+    minLevel = profile.minLevel;
+    if (profile.hasOutputLevels) restoreOutputLevels(profile);
+    updateLowestLevel();
+    lineLength = profile.lineLength;
+    lineCharacter = profile.lineCharacter;
+    overflowPolicy = profile.overflowPolicy;
+    format = profile.format;
+    if (profile.timestamp != timestampSource || profile.epochSource != epochSource) {
+      configureTimestamp(profile.timestamp, profile.epochSource);
+    }
+#if O3_LOG_RATE_LIMIT
+    suppressRepeats = profile.suppressRepeats;
+    if (profile.rateLimitPerSecond != rateLimitPerSecond || profile.rateLimitBurst != rateLimitBurst) {
+      rateLimitPerSecond = profile.rateLimitPerSecond;
+      rateLimitBurst = profile.rateLimitBurst;
+      refillBuckets();
+    }
+#endif
     resetLineState();
+    writeSettingsRecord();
   }
 
   // Small setters for runtime changes.
-  void setPrefix(const char* newPrefix) { copyPrefix(newPrefix); }
-  void setMinLevel(O3LogLevel level) { minLevel = level; }
-  void setPartSeparator(const char* value) { copyPartSeparator(value); }
+  void setPrefix(const char* newPrefix) {
+    copyPrefix(newPrefix);
+    writeSettingsRecord();
+  }
+  void setPrefix(const __FlashStringHelper* newPrefix) {
+    copyPrefix(newPrefix);
+    writeSettingsRecord();
+  }
+  void setMinLevel(O3LogLevel level) {
+    minLevel = level;
+    updateLowestLevel();
+  }
+  void setPartSeparator(const char* value) {
+    copyPartSeparator(value);
+    writeSettingsRecord();
+  }
+  void setPartSeparator(const __FlashStringHelper* value) {
+    copyPartSeparator(value);
+    writeSettingsRecord();
+  }
+
+  // Reads options.epochSource again and continues the epoch timestamps from there, for example
+  // after each NTP sync. Between syncs the seconds are extended with millis(), so the RTC is not
+  // read per line. Call it at least every 49 days (millis() wraps).
+  void syncEpoch() {
+    if (epochSource) setEpoch(epochSource());
+  }
+
+  // Same with a time you got elsewhere (GPS, a server response).
+  void setEpoch(uint32_t seconds) {
+    epochSeconds = seconds;
+    epochMillis = millis();
+    writeSettingsRecord();
+  }
 
   // Enable/disable all logging at once.
   void setEnabled(bool isEnabled) {
@@ -66,10 +836,422 @@ public:
 
   bool isEnabled() const { return enabled; }
 
+  // ---------------------------------------------------------------------------
+  // Extra outputs (O3_LOG_MAX_SINKS > 1)
+  //
+  // Mirrors every line to more streams, for example Serial + a WiFiClient + an SD File,
+  // each with its own minimum level. A line is formatted once, then written to every output
+  // that accepts its level. minLevel/setMinLevel() is the level of the Stream passed to begin().
+  //   sw.begin(Serial, 115200, options);
+  //   sw.addSink(logFile, O3LogLevel::Debug);
+  // ---------------------------------------------------------------------------
+
+  // Returns false if the sink is already registered or all slots are taken.
+  bool addSink(Print& sink, O3LogLevel sinkMinLevel = O3LogLevel::Debug) {
+    if (&sink == out || findSink(sink) >= 0) return false;
+    for (size_t i = 0; i < extraSinkCount; i++) {
+      Sink& slot = *sinkSlot(i);
+      if (!slot.stream) {
+        slot.stream = &sink;
+        slot.minLevel = sinkMinLevel;
+        slot.lineSink = nullptr;
+        slot.flushLevel = O3LogLevel::None;
+        slot.flushDue = false;
+        slot.inLine = false;
+        updateLowestLevel();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Same for line-aware outputs such as O3SyslogSink.
+  bool addSink(O3LineSink& sink, O3LogLevel sinkMinLevel = O3LogLevel::Debug) {
+    if (!addSink(static_cast<Print&>(sink), sinkMinLevel)) return false;
+    sinkSlot(findSink(sink))->lineSink = &sink;
+    return true;
+  }
+
+  bool removeSink(Print& sink) {
+    const int index = findSink(sink);
+    if (index < 0) return false;
+    Sink& slot = *sinkSlot(index);
+    if (slot.inLine) slot.lineSink->endLine();
+    slot.stream = nullptr;
+    slot.lineSink = nullptr;
+    slot.inLine = false;
+    updateLowestLevel();
+    return true;
+  }
+
+  // Changes the level of an extra sink, or of the begin() stream (same as setMinLevel()).
+  bool setSinkLevel(Print& sink, O3LogLevel sinkMinLevel) {
+    if (&sink == out) {
+      setMinLevel(sinkMinLevel);
+      return true;
+    }
+    const int index = findSink(sink);
+    if (index < 0) return false;
+    sinkSlot(index)->minLevel = sinkMinLevel;
+    updateLowestLevel();
+    return true;
+  }
+
+  // Calls sink.flush() after every complete line at flushLevel or above (default None, never).
+  // Works for the begin() stream too. Buffering outputs such as O3FileSink then get errors onto
+  // the card right away, Serial.flush() waits until an error line has left the UART.
+  bool setSinkFlushLevel(Print& sink, O3LogLevel flushLevel) {
+    if (&sink == out) {
+      outFlushLevel = flushLevel;
+      return true;
+    }
+    const int index = findSink(sink);
+    if (index < 0) return false;
+    sinkSlot(index)->flushLevel = flushLevel;
+    return true;
+  }
+
+  // ---------------------------------------------------------------------------
+  // Module tags (O3_LOG_MAX_TAGS > 0)
+  //
+  // A tag is a small handle with the same debug()/info()/warn()/error() calls. Its lines use the
+  // tag name as prefix and pass its own minimum level first, everything else (options, buffers,
+  // outputs) is shared with the writer:
+  //   O3LogTag mqtt = sw.tag("MQTT");
+  //   mqtt.info("Connected");              // [MQTT] 12345 INFO: Connected
+  //   mqtt.setMinLevel(O3LogLevel::Warn);  // quiet MQTT, other modules still log
+  // The name is not copied, pass a string literal or F("..."). Asking for a name again returns the
+  // same tag. If all O3_LOG_MAX_TAGS slots are taken (or tags are compiled out) the handle logs with
+  // the writer's own prefix. Crash log and backlog records keep the tag id and print its name when
+  // they are written out. Binary output records do not store the tag.
+  // ---------------------------------------------------------------------------
+
+  O3LogTag tag(const char* name);
+  O3LogTag tag(const __FlashStringHelper* name);
+
+  // ---------------------------------------------------------------------------
+  // Runtime commands (O3_LOG_COMMAND_BUFFER_SIZE > 0)
+  //
+  // Change levels from the serial monitor without reflashing. Call pollCommands() from loop(), it
+  // reads what the begin() stream has received (never waits) and runs every complete line:
+  //   lvl                list the levels
+  //   lvl NET debug      level of tag NET (debug, info, warn, error or none)
+  //   lvl * warn         level of all tags
+  //   lvl APP info       the writer's own prefix (or "-") sets minLevel of the begin() stream
+  // Names and levels ignore case. The writer answers with a "LOG:" line that shows the new levels.
+  // pollCommands() consumes all input of the stream, other lines are dropped. A sketch that reads
+  // the stream itself can pass its lines to handleCommand() instead.
+  // ---------------------------------------------------------------------------
+
+  // Returns true if at least one command was run.
+  bool pollCommands() {
+#if O3_LOG_COMMAND_BUFFER_SIZE > 0
+    if (!out) return false;
+    bool handled = false;
+    while (out->available() > 0) {
+      const int value = out->read();
+      if (value < 0) break;
+      const char c = static_cast<char>(value);
+      if (c == '\n' || c == '\r') {
+        if (commandLength > 0 && !commandOverflow) {
+          commandBuffer[commandLength] = '\0';
+          if (handleCommand(commandBuffer)) handled = true;
+        }
+        commandLength = 0;
+        commandOverflow = false;
+      } else if (static_cast<size_t>(commandLength) + 1 < commandBufferSize) {
+        commandBuffer[commandLength++] = c;
+      } else {
+        commandOverflow = true;
+      }
+    }
+    return handled;
+#else
+    return false;
+#endif
+  }
+
+  // Runs one command line (without line ending). Returns false if it is not a log command.
+  bool handleCommand(const char* text) {
+    if (!text) return false;
+    const char* word;
+    size_t wordLength = nextWord(text, word);
+    if (!wordIs(word, wordLength, "lvl")) return false;
+
+    const char* name;
+    const size_t nameLength = nextWord(text, name);
+    const char* levelName;
+    const size_t levelLength = nextWord(text, levelName);
+    if (nameLength == 0) {
+      writeLevels();
+      return true;
+    }
+    O3LogLevel level;
+    if (!parseLevel(levelName, levelLength, level) || nextWord(text, word) > 0) {
+      writeCommandNote(F("usage: lvl [tag|*] [debug|info|warn|error|none]"), nullptr, 0);
+      return true;
+    }
+
+    if (nameLength == 1 && name[0] == '*') {
+      for (size_t i = 0; i < tagCount; i++) {
+        Tag& entry = *tagSlot(i);
+        if (entry.name) entry.minLevel = level;
+      }
+    } else if (const uint8_t id = findTagIgnoreCase(name, nameLength)) {
+      tagSlot(id - 1)->minLevel = level;
+    } else if ((nameLength == 1 && name[0] == '-') || wordIs(name, nameLength, prefixBuffer + 1, prefixLength)) {
+      setMinLevel(level);
+    } else {
+      writeCommandNote(F("unknown tag "), name, nameLength);
+      return true;
+    }
+    writeLevels();
+    return true;
+  }
+
+  // ---------------------------------------------------------------------------
+  // Async mode (O3_LOG_ASYNC_BUFFER_SIZE > 0)
+  //
+  // Log calls queue finished lines in a ring buffer, pump() sends them.
+  // Call pump() once per loop() pass. It only sends what availableForWrite() reports,
+  // so it never blocks. For streams that do not implement availableForWrite() (it returns 0),
+  // use pump(maxBytes) instead. pump() may also be called from a timer ISR on single-core boards,
+  // as long as the Stream itself can be written from that ISR.
+  // With O3_LOG_THREAD_SAFE any task may call pump(), but not an ISR.
+  // Without async mode these functions do nothing and return 0.
+  // ---------------------------------------------------------------------------
+
+  size_t pump() {
+    if (!out) return 0;
+    const int room = out->availableForWrite();
+    return room > 0 ? pump(static_cast<size_t>(room)) : 0;
+  }
+
+  size_t pump(size_t maxBytes) {
+#if O3_LOG_ASYNC_BUFFER_SIZE > 0
+#if O3_LOG_THREAD_SAFE
+    LockGuard guard(mutex);
+#endif
+    return pumpQueued(maxBytes);
+#else
+    (void)maxBytes;
+    return 0;
+#endif
+  }
+
+  // Sends everything that is queued, blocking until done. Useful before sleep or reset.
+  void drain() {
+#if O3_LOG_ASYNC_BUFFER_SIZE > 0
+    while (pendingBytes() > 0 && pump(asyncBufferSize) > 0) {
+    }
+#endif
+  }
+
+  // Bytes queued in the ring buffer and not sent yet.
+  size_t pendingBytes() const {
+#if O3_LOG_ASYNC_BUFFER_SIZE > 0
+    InterruptGuard guard;
+    return asyncIndex(asyncHead + asyncBufferSize - asyncTail);
+#else
+    return 0;
+#endif
+  }
+
+  // Number of lines discarded because the ring buffer was full.
+  uint32_t droppedLines() const { return droppedLineCount; }
+
+  // Number of lines held back by the rate limit or collapsed as repeats.
+  uint32_t suppressedLines() const {
+#if O3_LOG_RATE_LIMIT
+    return suppressedLineCount;
+#else
+    return 0;
+#endif
+  }
+
+  // ---------------------------------------------------------------------------
+  // Statistics (O3_LOG_STATS = 1)
+  //
+  // Shows how much of the loop budget logging takes. Without O3_LOG_STATS stats() returns
+  // zeros (except droppedLines) and printStats() prints nothing.
+  // ---------------------------------------------------------------------------
+
+  O3LogStats stats() const {
+#if O3_LOG_STATS
+    O3LogStats current = statsData;
+#else
+    O3LogStats current;
+#endif
+    current.droppedLines = droppedLineCount;
+    current.suppressedLines = suppressedLines();
+    return current;
+  }
+
+  void resetStats() {
+#if O3_LOG_STATS
+    statsData = O3LogStats();
+    lineWriteMicros = 0;
+#endif
+  }
+
+  // Prints the counters in one line, like printOptions().
+  void printStats() {
+#if O3_LOG_STATS
+    if (!canWrite(defaultLevel)) return;
+    // Taken before the line is written, so it does not count itself.
+    const O3LogStats current = stats();
+    LineWriter line(*this, defaultLevel);
+    beginLine(line, defaultLevel);
+    writeFlash(line, F("stats lines="));
+    writePart(line, current.linesWritten);
+    writeFlash(line, F(" filtered="));
+    writePart(line, current.linesFiltered);
+    writeFlash(line, F(" bytes="));
+    writePart(line, current.bytesWritten);
+    writeFlash(line, F(" writeUs="));
+    writePart(line, current.writeMicros);
+    writeFlash(line, F(" longestLineUs="));
+    writePart(line, current.longestLineMicros);
+#if O3_LOG_ASYNC_BUFFER_SIZE > 0
+    writeFlash(line, F(" asyncHighWater="));
+    writePart(line, current.asyncHighWater);
+    writeFlash(line, F(" dropped="));
+    writePart(line, current.droppedLines);
+#endif
+#if O3_LOG_RATE_LIMIT
+    writeFlash(line, F(" suppressed="));
+    writePart(line, current.suppressedLines);
+#endif
+    finishLine(line);
+#endif
+  }
+
+  // ---------------------------------------------------------------------------
+  // Crash log (O3_LOG_PERSIST_BUFFER_SIZE > 0)
+  //
+  // Keeps the last lines in memory that survives a watchdog or software reset, so the next boot
+  // can still show what happened before it:
+  //   O3_LOG_NOINIT O3PersistentLog crashLog;
+  //   sw.begin(Serial, 115200, options);
+  //   sw.persistTo(crashLog);   // keeps what the previous run stored
+  //   sw.dumpPersisted();       // prints it with the usual header
+  //   sw.clearPersisted();
+  // debug()/info()/warn()/error()/hexdump() lines at sinkMinLevel or above are stored as binary
+  // records (timestamp and level in a few bytes, integers as varints), whatever the output format is.
+  // When the ring is full the oldest records are overwritten. print() chains, drawLine() and
+  // printOptions() are not stored. Without the crash log these functions do nothing.
+  // ---------------------------------------------------------------------------
+
+  // Starts storing lines in log. Returns true if it still holds records from before the reset,
+  // a "----- reset -----" line then separates them from the new ones in dumpPersisted().
+  bool persistTo(O3PersistentLog& log, O3LogLevel sinkMinLevel = O3LogLevel::Debug) {
+#if O3_LOG_PERSIST_BUFFER_SIZE > 0
+    const bool valid = persistValid(log);
+    const bool kept = valid && persistHead(log) != persistTail(log);
+    if (!valid) {
+      log.magic = persistMagic;
+      log.position = 0;
+    }
+    if (kept) {
+      PersistWriter marker(log.bytes, log.position);
+      marker.write(persistResetMarker);
+      marker.finish();
+    }
+    persistLog = &log;
+    persistLevel = sinkMinLevel;
+    updateLowestLevel();
+    return kept;
+#else
+    (void)log;
+    (void)sinkMinLevel;
+    return false;
+#endif
+  }
+
+  // Writes the stored lines, oldest first, as text lines to the outputs that accept their level.
+  // Timestamps are the ones the lines had when they were logged. Returns the number of lines.
+  // With O3_LOG_THREAD_SAFE call it before other tasks start logging.
+  size_t dumpPersisted() {
+#if O3_LOG_PERSIST_BUFFER_SIZE > 0
+    if (!persistLog || !out) return 0;
+    const O3PersistentLog& log = *persistLog;
+    const size_t head = persistHead(log);
+    size_t index = persistTail(log);
+    size_t count = 0;
+    while (index != head) {
+      const uint8_t length = log.bytes[index];
+      PersistReader record(log.bytes, persistIndex(index + 1), length);
+      if (replayRecord(record)) count++;
+      index = persistIndex(index + 1 + length);
+    }
+    return count;
+#else
+    return 0;
+#endif
+  }
+
+  void clearPersisted() {
+#if O3_LOG_PERSIST_BUFFER_SIZE > 0
+    if (persistLog) persistLog->position = 0;
+#endif
+  }
+
+  // ---------------------------------------------------------------------------
+  // Pre-trigger backlog (O3_LOG_BACKLOG_BUFFER_SIZE > 0)
+  //
+  // Keeps the detail of the normal case off the link and still shows it when something fails:
+  //   options.minLevel = O3LogLevel::Debug;
+  //   sw.begin(Serial, 115200, options);
+  //   sw.setBacklogTrigger(O3LogLevel::Warn);
+  // debug()/info() lines are now stored as compact records in a RAM ring instead of being written.
+  // The next warn() or error() line first writes them, oldest first, with their original
+  // timestamps and the usual header. When the ring is full the oldest records are overwritten.
+  // print() chains, drawLine() and printOptions() are written as usual. In Json and Logfmt
+  // output nothing is kept. Without the backlog these functions do nothing.
+  // ---------------------------------------------------------------------------
+
+  // Lines below level are kept back until a line at level or above comes along.
+  // O3LogLevel::Debug turns the backlog off, lines already kept stay until dumpBacklog().
+  void setBacklogTrigger(O3LogLevel level) {
+#if O3_LOG_BACKLOG_BUFFER_SIZE > 0
+    backlogLevel = level;
+#else
+    (void)level;
+#endif
+  }
+
+  // Writes the kept lines now, for example before going to sleep. Returns the number of lines.
+  size_t dumpBacklog() {
+#if O3_LOG_BACKLOG_BUFFER_SIZE > 0
+    if (!out) return 0;
+    uint8_t record[BacklogWriter::maxRecord];
+    size_t length;
+    size_t count = 0;
+    while (takeBacklogRecord(record, length)) {
+      RecordReader<BacklogWriter::maxRecord> reader(record, 0, length);
+      if (replayRecord(reader)) count++;
+    }
+    return count;
+#else
+    return 0;
+#endif
+  }
+
+  void clearBacklog() {
+#if O3_LOG_BACKLOG_BUFFER_SIZE > 0
+#if O3_LOG_THREAD_SAFE
+    LockGuard guard(mutex);
+#endif
+    backlogPosition = 0;
+#endif
+  }
+
   // ---------------------------------------------------------------------------
   // Low-level print/println (defaultLevel = Info)
   // These are useful when you want to manually build a line with multiple calls.
   // The header is printed only once per line.
+  // With O3_LOG_THREAD_SAFE each call is written in one piece, but a chain of calls is not:
+  // a line from another task can end up between two print() calls of the same line.
   // ---------------------------------------------------------------------------
 
   template <typename T>
@@ -84,69 +1266,102 @@ public:
 
   void println() {
     if (!canWrite(defaultLevel)) return;
-    ensureLineHeader(defaultLevel);
-    out->println();
-    resetLineState();
+    LineWriter line(*this, defaultLevel);
+    line.acquire();
+    ensureLineHeader(line, defaultLevel);
+    endLine(line);
+  }
+
+  // Repeats character count times as part of the current print() line, for columns and simple bars:
+  //   sw.print("rssi"); sw.fill(' ', 8 - 4); sw.fill('#', bars); sw.println();
+  void fill(char character, size_t count) {
+    fillWithLevel(defaultLevel, character, count);
+  }
+
+  void fillWithLevel(O3LogLevel level, char character, size_t count) {
+    if (!canWrite(level)) return;
+    LineWriter line(*this, level);
+    line.acquire();
+    ensureLineHeader(line, level);
+    writeFill(line, character, count);
   }
 
   // Quick visual separator: prints a horizontal line with header and newline.
   void drawLine(size_t length = 0, char character = '\0') {
     if (!canWrite(defaultLevel)) return;
-    ensureLineHeader(defaultLevel);
+    LineWriter line(*this, defaultLevel);
+    beginLine(line, defaultLevel);
     const size_t effectiveLength = length > 0 ? length : lineLength;
     const char effectiveChar = character != '\0' ? character : lineCharacter;
-    for (size_t i = 0; i < effectiveLength; ++i) {
-      out->print(effectiveChar);
-    }
-    out->println();
-    resetLineState();
+    writeFill(line, effectiveChar, effectiveLength);
+    finishLine(line);
   }
 
   // Prints current configuration in one line for quick diagnostics.
   void printOptions() {
     if (!canWrite(defaultLevel)) return;
-    ensureLineHeader(defaultLevel);
-    out->print("options ");
-    out->print("enabled=");
-    out->print(enabled ? "true" : "false");
-    out->print(" prefix=\"");
-    out->print(prefixBuffer);
-    out->print("\" showMillis=");
-    out->print(showMillis ? "true" : "false");
-    out->print(" showLevel=");
-    out->print(showLevel ? "true" : "false");
-    out->print(" minLevel=");
-    out->print(levelText(minLevel));
-    out->print(" partSeparator=\"");
-    out->print(partSeparatorBuffer);
-    out->print("\" lineLength=");
-    out->print(lineLength);
-    out->print(" lineCharacter='");
-    out->print(lineCharacter);
-    out->print('\'');
-    out->println();
-    resetLineState();
+    LineWriter line(*this, defaultLevel);
+    beginLine(line, defaultLevel);
+    writeFlash(line, F("options enabled="));
+    writeFlash(line, enabled ? F("true") : F("false"));
+    writeFlash(line, F(" prefix=\""));
+    line.write(prefixBuffer + 1, prefixLength);
+    writeFlash(line, F("\" showMillis="));
+    writeFlash(line, showMillis ? F("true") : F("false"));
+    writeFlash(line, F(" showLevel="));
+    writeFlash(line, showLevel ? F("true") : F("false"));
+    writeFlash(line, F(" minLevel="));
+    writeFlash(line, levelText(minLevel));
+    writeFlash(line, F(" partSeparator=\""));
+    line.print(partSeparatorBuffer);
+    writeFlash(line, F("\" lineLength="));
+    writePart(line, lineLength);
+    writeFlash(line, F(" lineCharacter='"));
+    line.print(lineCharacter);
+    line.print('\'');
+#if O3_LOG_ASYNC_BUFFER_SIZE > 0
+    writeFlash(line, F(" overflowPolicy="));
+    writeFlash(line, overflowPolicyText(overflowPolicy));
+#endif
+#if O3_LOG_RATE_LIMIT
+    if (rateLimitPerSecond > 0) {
+      writeFlash(line, F(" rateLimitPerSecond="));
+      writePart(line, rateLimitPerSecond);
+      writeFlash(line, F(" rateLimitBurst="));
+      writePart(line, rateLimitBurst);
+    }
+    if (suppressRepeats) writeFlash(line, F(" suppressRepeats=true"));
+#endif
+    if (timestampSource != O3TimestampSource::Millis) {
+      writeFlash(line, F(" timestamp="));
+      writeFlash(line, timestampText(timestampSource));
+    }
+    finishLine(line);
   }
 
   template <typename T>
   void printWithLevel(O3LogLevel level, const T& value) {
     if (!canWrite(level)) return;
-    ensureLineHeader(level);
-    out->print(value);
+    LineWriter line(*this, level);
+    line.acquire();
+    ensureLineHeader(line, level);
+    writePart(line, value);
   }
 
   template <typename T>
   void printlnWithLevel(O3LogLevel level, const T& value) {
     if (!canWrite(level)) return;
-    ensureLineHeader(level);
-    out->println(value);
-    resetLineState();
+    LineWriter line(*this, level);
+    line.acquire();
+    ensureLineHeader(line, level);
+    writePart(line, value);
+    endLine(line);
   }
 
   // ---------------------------------------------------------------------------
   // High-level log API
   //
-  // Overload #1: single message (const char*)
+  // Overload #1: single message (const char* or F("..."))
   // Overload #2: variadic template (First, Rest...) which allows 2+ parts
   //
   // Example:
@@ -157,26 +1372,139 @@ public:
   // In C++, "variadic templates" are the type-safe equivalent of C# params.
   // ---------------------------------------------------------------------------
 
-  void debug(const char* message) { line(O3LogLevel::Debug, message); }
-  void info(const char* message)  { line(O3LogLevel::Info,  message); }
-  void warn(const char* message)  { line(O3LogLevel::Warn,  message); }
-  void error(const char* message) { line(O3LogLevel::Error, message); }
+  // F("...") messages stay in flash, on AVR they do not use any SRAM.
+  void debug(const __FlashStringHelper* message) { if constexpr (o3LogLevelCompiledIn(O3LogLevel::Debug)) line(O3LogLevel::Debug, 0, message); }
+  void info(const __FlashStringHelper* message)  { if constexpr (o3LogLevelCompiledIn(O3LogLevel::Info))  line(O3LogLevel::Info,  0, message); }
+  void warn(const __FlashStringHelper* message)  { if constexpr (o3LogLevelCompiledIn(O3LogLevel::Warn))  line(O3LogLevel::Warn,  0, message); }
+  void error(const __FlashStringHelper* message) { if constexpr (o3LogLevelCompiledIn(O3LogLevel::Error)) line(O3LogLevel::Error, 0, message); }
+
+  void debug(const char* message) { if constexpr (o3LogLevelCompiledIn(O3LogLevel::Debug)) line(O3LogLevel::Debug, 0, message); }
+  void info(const char* message)  { if constexpr (o3LogLevelCompiledIn(O3LogLevel::Info))  line(O3LogLevel::Info,  0, message); }
+  void warn(const char* message)  { if constexpr (o3LogLevelCompiledIn(O3LogLevel::Warn))  line(O3LogLevel::Warn,  0, message); }
+  void error(const char* message) { if constexpr (o3LogLevelCompiledIn(O3LogLevel::Error)) line(O3LogLevel::Error, 0, message); }
 
   // Variadic overloads: accept any number of parts (2 or more) and print them separated.
   // Signature explanation:
   //   First is the first argument type, Rest... are the remaining argument types.
   //   const First& means "pass by reference", avoids copies for bigger types.
   template <typename First, typename... Rest>
-  void debug(const First& first, const Rest&... rest) { parts(O3LogLevel::Debug, first, rest...); }
+  void debug(const First& first, const Rest&... rest) {
+    if constexpr (o3LogLevelCompiledIn(O3LogLevel::Debug)) parts(O3LogLevel::Debug, 0, 0, first, rest...);
+  }
 
   template <typename First, typename... Rest>
-  void info(const First& first, const Rest&... rest) { parts(O3LogLevel::Info, first, rest...); }
+  void info(const First& first, const Rest&... rest) {
+    if constexpr (o3LogLevelCompiledIn(O3LogLevel::Info)) parts(O3LogLevel::Info, 0, 0, first, rest...);
+  }
 
   template <typename First, typename... Rest>
-  void warn(const First& first, const Rest&... rest) { parts(O3LogLevel::Warn, first, rest...); }
+  void warn(const First& first, const Rest&... rest) {
+    if constexpr (o3LogLevelCompiledIn(O3LogLevel::Warn)) parts(O3LogLevel::Warn, 0, 0, first, rest...);
+  }
 
   template <typename First, typename... Rest>
-  void error(const First& first, const Rest&... rest) { parts(O3LogLevel::Error, first, rest...); }
+  void error(const First& first, const Rest&... rest) {
+    if constexpr (o3LogLevelCompiledIn(O3LogLevel::Error)) parts(O3LogLevel::Error, 0, 0, first, rest...);
+  }
+
+  // Named part: sw.info("Backoff", sw.kv("backoff", backoff), sw.kv(F("unit"), "ms"));
+  // The value is referenced, not copied, so use kv() only inside the log call.
+  template <typename Value>
+  static O3KeyValue<const char*, Value> kv(const char* key, const Value& value) {
+    return { key, value };
+  }
+
+  template <typename Value>
+  static O3KeyValue<const __FlashStringHelper*, Value> kv(const __FlashStringHelper* key, const Value& value) {
+    return { key, value };
+  }
+
+  // Text slice without a terminating NUL, written with one write():
+  //   sw.info("cmd", sw.span(input + start, length));
+  // Like kv(), the text is referenced, not copied.
+  static O3Span span(const char* data, size_t length)    { return { data, length }; }
+  static O3Span span(const uint8_t* data, size_t length) { return { reinterpret_cast<const char*>(data), length }; }
+
+  // Float part with a chosen number of decimals (0..9): sw.info("T", sw.fixed(temperature, 1));
+  // Plain float/double parts print with 2 decimals, like Serial.print().
+  static O3Fixed<float> fixed(float value, uint8_t decimals)   { return { value, decimals }; }
+  static O3Fixed<double> fixed(double value, uint8_t decimals) { return { value, decimals }; }
+
+  // printf-style lines, formatted straight into the line (no snprintf buffer, no vfprintf):
+  //   sw.infof("%-8s %5d ms", name, elapsed);        // [NET] 12345 INFO: wifi        42 ms
+  //   sw.infof(F("%-8s %5d ms"), name, elapsed);     // format in flash
+  //   sw.infof(O3_FMT("%-8s %5d ms"), name, elapsed); // checked at compile time
+  // Conversions: %d %i %u %x %X %o %c %s %f %%, with the flags - 0 + space #, width and precision.
+  // Length modifiers (l, ll, h, z) are accepted and ignored, the argument type is known anyway.
+  // Without O3_FMT a conversion that does not fit its argument prints the argument as usual,
+  // and conversions without an argument are printed as they are.
+  template <typename Format, typename... Args>
+  void debugf(const Format& text, const Args&... args) {
+    if constexpr (o3LogLevelCompiledIn(O3LogLevel::Debug)) formatLine(O3LogLevel::Debug, 0, text, args...);
+  }
+
+  template <typename Format, typename... Args>
+  void infof(const Format& text, const Args&... args) {
+    if constexpr (o3LogLevelCompiledIn(O3LogLevel::Info)) formatLine(O3LogLevel::Info, 0, text, args...);
+  }
+
+  template <typename Format, typename... Args>
+  void warnf(const Format& text, const Args&... args) {
+    if constexpr (o3LogLevelCompiledIn(O3LogLevel::Warn)) formatLine(O3LogLevel::Warn, 0, text, args...);
+  }
+
+  template <typename Format, typename... Args>
+  void errorf(const Format& text, const Args&... args) {
+    if constexpr (o3LogLevelCompiledIn(O3LogLevel::Error)) formatLine(O3LogLevel::Error, 0, text, args...);
+  }
+
+  // Same as the level functions above, with the level chosen at run time and a callsite id
+  // that binary records carry (text output ignores it). The O3_LOG_* macros pass O3_LOG_CALLSITE_ID.
+  template <typename First, typename... Rest>
+  void logWithId(O3LogLevel level, uint16_t callsiteId, const First& first, const Rest&... rest) {
+    parts(level, 0, callsiteId, first, rest...);
+  }
+
+  // Classic hex dump, one log line (with the usual header) per row:
+  //   [NET] 12345 DEBUG: 0000: 48 65 6c 6c 6f 0a 00 ff  |Hello...|
+  // Each row is formatted into one stack buffer and written with a single call.
+  // bytesPerLine is clamped to 1..32. In Binary/Json/Logfmt mode each row is one text part.
+  void hexdump(O3LogLevel level, const uint8_t* data, size_t length, uint8_t bytesPerLine = 16) {
+    if (!canWrite(level) || !data) return;
+    if (bytesPerLine == 0) bytesPerLine = 1;
+    if (bytesPerLine > hexdumpMaxBytesPerLine) bytesPerLine = hexdumpMaxBytesPerLine;
+    const uint8_t offsetDigits = length > 0x10000 ? 8 : 4;
+
+    char row[8 + 2 + hexdumpMaxBytesPerLine * 3 + 1 + 1 + hexdumpMaxBytesPerLine + 1 + 1];
+    for (size_t offset = 0; offset < length; offset += bytesPerLine) {
+      const size_t count = length - offset < bytesPerLine ? length - offset : bytesPerLine;
+      char* p = row;
+      for (uint8_t shift = offsetDigits * 4; shift > 0; shift -= 4) {
+        *p++ = O3Format::hexDigit(static_cast<uint8_t>((offset >> (shift - 4)) & 0x0F));
+      }
+      *p++ = ':';
+      for (size_t i = 0; i < bytesPerLine; i++) {
+        *p++ = ' ';
+        if (i < count) {
+          O3Format::formatHexByte(p, data[offset + i]);
+        } else {
+          p[0] = ' ';
+          p[1] = ' ';
+        }
+        p += 2;
+      }
+      *p++ = ' ';
+      *p++ = ' ';
+      *p++ = '|';
+      for (size_t i = 0; i < count; i++) {
+        const uint8_t c = data[offset + i];
+        *p++ = c >= 0x20 && c < 0x7F ? static_cast<char>(c) : '.';
+      }
+      *p++ = '|';
+      *p = '\0';
+      writeLine(level, 0, 0, static_cast<const char*>(row));
+    }
+  }
 
 private:
   // Stream is Arduino's generic "thing you can print to" base type.
@@ -186,145 +1514,2618 @@ private:
   bool enabled = true;
   bool showMillis = true;
   bool showLevel = true;
+  uint8_t millisWidth = 0;
 
   O3LogLevel minLevel = O3LogLevel::Debug;
   O3LogLevel defaultLevel = O3LogLevel::Info;
 
+  // Output list beyond `out`. canWrite() checks lowestLevel, the most verbose level of all
+  // outputs, so a line nobody wants is rejected with one comparison.
+  // flushDue is set while a line that reached flushLevel is on its way to the sink,
+  // inLine while a line sink got beginLine() but not yet endLine().
+  struct Sink {
+    Print* stream = nullptr;
+    O3LineSink* lineSink = nullptr;
+    O3LogLevel minLevel = O3LogLevel::Debug;
+    O3LogLevel flushLevel = O3LogLevel::None;
+    bool flushDue = false;
+    bool inLine = false;
+  };
+  static constexpr size_t extraSinkCount = O3_LOG_MAX_SINKS > 1 ? O3_LOG_MAX_SINKS - 1 : 0;
+#if O3_LOG_MAX_SINKS > 1
+  Sink extraSinks[extraSinkCount];
+#endif
+  // Slot index (0 ... extraSinkCount - 1). Loops up to extraSinkCount compile without the array.
+  Sink* sinkSlot(size_t index) {
+#if O3_LOG_MAX_SINKS > 1
+    return &extraSinks[index];
+#else
+    (void)index;
+    return nullptr;
+#endif
+  }
+  const Sink* sinkSlot(size_t index) const { return const_cast<O3SerialWriter*>(this)->sinkSlot(index); }
+  O3LogLevel lowestLevel = O3LogLevel::Debug;
+  O3LogLevel outFlushLevel = O3LogLevel::None;
+  bool outFlushDue = false;
+  bool sinkLineWork = false; // Some sink needs flush() or endLine() when the line is done
+
+  // Tags handed out by tag(), id = index + 1. name points to the caller's string (RAM or flash),
+  // length is capped like the prefix.
+  friend class O3LogTag;
+  struct Tag {
+    const char* name = nullptr;
+    uint8_t length = 0;
+    bool flashName = false;
+    O3LogLevel minLevel = O3LogLevel::Debug;
+  };
+  static constexpr size_t tagCount = O3_LOG_MAX_TAGS;
+  static_assert(tagCount < 255, "O3_LOG_MAX_TAGS must be below 255");
+#if O3_LOG_MAX_TAGS > 0
+  Tag tags[tagCount];
+#endif
+  // Slot of tag id index + 1, like sinkSlot().
+  Tag* tagSlot(size_t index) {
+#if O3_LOG_MAX_TAGS > 0
+    return &tags[index];
+#else
+    (void)index;
+    return nullptr;
+#endif
+  }
+  const Tag* tagSlot(size_t index) const { return const_cast<O3SerialWriter*>(this)->tagSlot(index); }
+
+#if O3_LOG_COMMAND_BUFFER_SIZE > 0
+  // Input line collected by pollCommands(), commandOverflow skips the rest of a line that is too long.
+  static constexpr size_t commandBufferSize = O3_LOG_COMMAND_BUFFER_SIZE;
+  static_assert(commandBufferSize >= 8 && commandBufferSize <= 255, "O3_LOG_COMMAND_BUFFER_SIZE must be 8..255");
+  char commandBuffer[commandBufferSize];
+  uint8_t commandLength = 0;
+  bool commandOverflow = false;
+#endif
+
+#if O3_LOG_BACKLOG_BUFFER_SIZE > 0
+  // Record ring of the backlog, backlogPosition is head | tail << 16 like O3PersistentLog::position.
+  static constexpr size_t backlogBufferSize = O3_LOG_BACKLOG_BUFFER_SIZE;
+  static_assert(backlogBufferSize >= 32 && backlogBufferSize <= 0xFFFF, "O3_LOG_BACKLOG_BUFFER_SIZE must be 32..65535");
+  uint8_t backlogBytes[backlogBufferSize];
+  volatile uint32_t backlogPosition = 0;
+  O3LogLevel backlogLevel = O3LogLevel::Debug; // Trigger level, Debug = nothing is kept
+#endif
+
+#if O3_LOG_PERSIST_BUFFER_SIZE > 0
+  O3PersistentLog* persistLog = nullptr;
+  O3LogLevel persistLevel = O3LogLevel::Debug;
+  O3LogLevel outputLevel = O3LogLevel::Debug; // lowestLevel without the crash log
+#endif
+
   // These track whether we already printed the header for the current line.
   bool lineOpen = false;
   O3LogLevel activeLevel = O3LogLevel::Info;
+  uint8_t activeTag = 0;
 
   // Fixed-size buffers (no heap allocation).
   // Arduino-friendly: avoid dynamic allocation to reduce memory fragmentation.
-  static constexpr size_t prefixMaxLen = 32;
-  char prefixBuffer[prefixMaxLen] = "";
+  // The prefix is stored pre-rendered as the start of the header, "[NET] ", so each line
+  // writes it with one block write. prefixLength is the length of the prefix text itself.
+  static constexpr size_t prefixMaxLen = O3LogProfile::prefixMaxLen;
+  char prefixBuffer[prefixMaxLen + 3] = "";
+  uint8_t prefixLength = 0;
 
-  static constexpr size_t partSepMaxLen = 8;
+  static constexpr size_t partSepMaxLen = O3LogProfile::partSepMaxLen;
   char partSeparatorBuffer[partSepMaxLen] = " ";
 
-  static constexpr size_t defaultLineLength = 40;
-  static constexpr char defaultLineCharacter = '-';
+  static constexpr size_t defaultLineLength = O3LogProfile::defaultLineLength;
+  static constexpr char defaultLineCharacter = O3LogProfile::defaultLineCharacter;
   size_t lineLength = defaultLineLength;
   char lineCharacter = defaultLineCharacter;
 
-  // Safe copy into fixed-size buffer (always null-terminated).
-  void copyPrefix(const char* value) {
-    if (!value) value = "";
-    size_t i = 0;
-    for (; i + 1 < prefixMaxLen && value[i] != '\0'; i++) {
-      prefixBuffer[i] = value[i];
+  O3OverflowPolicy overflowPolicy = O3OverflowPolicy::DropNewest;
+  uint32_t droppedLineCount = 0;
+
+#if O3_LOG_RATE_LIMIT
+  // Token bucket per level (Debug..Error), in 1/1000 lines so the refill needs no division.
+  static constexpr size_t throttleLevels = 4;
+  static constexpr size_t throttleNoteMaxLen = 48; // " lines suppressed by rate limit" and 10 digits
+  uint16_t rateLimitPerSecond = 0;
+  uint8_t rateLimitBurst = 10;
+  bool suppressRepeats = false;
+  uint32_t bucketTokens[throttleLevels] = {};
+  uint32_t bucketRefilled[throttleLevels] = {};
+
+  // The last line that went out, as a hash of its level, callsite id and part values.
+  static constexpr uint32_t repeatReportInterval = 10000; // ms between summaries of a long run of repeats
+  uint32_t repeatHash = 0;
+  bool repeatHashValid = false;
+  O3LogLevel repeatLevel = O3LogLevel::Info;
+  uint8_t repeatTag = 0;
+  uint32_t repeatCount = 0;
+  uint32_t repeatSince = 0;
+  uint32_t rateLimitedCount = 0; // Since the last line that got through
+  uint32_t suppressedLineCount = 0;
+#endif
+
+#if O3_LOG_STATS
+  O3LogStats statsData;
+  uint32_t lineWriteMicros = 0; // write() time of the line currently going out
+#endif
+  O3LogFormat format = O3LogFormat::Text;
+
+  // Timestamp column, see configureTimestamp().
+  O3TimestampSource timestampSource = O3TimestampSource::Millis;
+  uint32_t (*epochSource)() = nullptr;
+  uint32_t epochSeconds = 0;  // Unix time at epochMillis
+  uint32_t epochMillis = 0;
+  uint32_t previousTimestamp = 0; // For the delta sources
+  uint32_t (*readTimestamp)(O3SerialWriter&) = readMillis;
+  size_t (*formatTimestamp)(O3SerialWriter&, char*) = formatCounter;
+
+  static constexpr size_t lineBufferSize = O3_LOG_LINE_BUFFER_SIZE;
+  static constexpr uint8_t hexdumpMaxBytesPerLine = 32;
+
+#if O3_LOG_THREAD_SAFE
+  static_assert(lineBufferSize > 0, "O3_LOG_THREAD_SAFE needs O3_LOG_LINE_BUFFER_SIZE > 0");
+
+  O3LogMutex mutex;
+
+  struct LockGuard {
+    O3LogMutex& mutex;
+    explicit LockGuard(O3LogMutex& target) : mutex(target) { mutex.lock(); }
+    ~LockGuard() { mutex.unlock(); }
+  };
+#endif
+
+  // Print adapter used for everything that belongs to one log line.
+  // Created on the stack by each public call, it collects the bytes in a fixed-size buffer and
+  // sends them with one out->write() when it goes out of scope (or when the buffer is full).
+  // Because it derives from Print, all the usual print(value) overloads work on it.
+  class LineWriter : public Print {
+  public:
+    LineWriter(O3SerialWriter& writer, O3LogLevel lineLevel) : level(lineLevel), owner(writer) {}
+    LineWriter(const LineWriter&) = delete;
+    LineWriter& operator=(const LineWriter&) = delete;
+    ~LineWriter() {
+      commit();
+      release();
+    }
+
+    using Print::write;
+
+    size_t write(uint8_t value) override {
+      if constexpr (lineBufferSize == 0) {
+        owner.deliver(level, &value, 1);
+        return 1;
+      } else {
+        buffer[length++] = value;
+        if (length == lineBufferSize) commit();
+        return 1;
+      }
+    }
+
+    size_t write(const uint8_t* data, size_t size) override {
+      if constexpr (lineBufferSize == 0) {
+        owner.deliver(level, data, size);
+        return size;
+      } else {
+        const size_t total = size;
+        while (size > 0) {
+          size_t chunk = lineBufferSize - length;
+          if (chunk > size) chunk = size;
+          memcpy(buffer + length, data, chunk);
+          length += chunk;
+          data += chunk;
+          size -= chunk;
+          if (length == lineBufferSize) commit();
+        }
+        return total;
+      }
     }
-    prefixBuffer[i] = '\0';
+
+    // Sends whatever is buffered to the stream in one block.
+    void commit() {
+      if constexpr (lineBufferSize > 0) {
+        if (length == 0) return;
+        acquire();
+        owner.deliver(level, buffer, length);
+        length = 0;
+      }
+    }
+
+    // O3_LOG_THREAD_SAFE: the first commit() takes the writer lock and the line keeps it
+    // until it goes out of scope, so a line reaches the outputs in one piece.
+    void acquire() {
+#if O3_LOG_THREAD_SAFE
+      if (locked) return;
+      owner.mutex.lock();
+      locked = true;
+#endif
+    }
+
+    void release() {
+#if O3_LOG_THREAD_SAFE
+      if (!locked) return;
+      locked = false;
+      owner.mutex.unlock();
+#endif
+    }
+
+    // Level of the line the bytes belong to, decides which outputs receive them.
+    O3LogLevel level;
+    // Module tag whose name the header shows instead of the prefix, 0 = none.
+    uint8_t tag = 0;
+
+  private:
+    O3SerialWriter& owner;
+#if O3_LOG_THREAD_SAFE
+    bool locked = false;
+#endif
+    size_t length = 0;
+    uint8_t buffer[lineBufferSize > 0 ? lineBufferSize : 1];
+  };
+
+#if O3_LOG_ASYNC_BUFFER_SIZE > 0
+  static constexpr size_t asyncBufferSize = O3_LOG_ASYNC_BUFFER_SIZE;
+  static_assert(asyncBufferSize >= 16, "O3_LOG_ASYNC_BUFFER_SIZE is too small to hold a line");
+
+  // Ring layout: every line is stored as [length low][length high][level][bytes...].
+  // The producer (log calls) only publishes asyncHead once a line is complete, so pump() never
+  // sends half a line. pump() is the only consumer and advances asyncTail.
+  uint8_t asyncBuffer[asyncBufferSize];
+  volatile size_t asyncHead = 0;             // End of the last complete line
+  volatile size_t asyncTail = 0;             // Next byte pump() sends
+  size_t asyncSendRemaining = 0;             // Bytes of the line pump() is in the middle of
+  size_t asyncSendAhead = 0;                 // Bytes the other outputs already got beyond the first one
+  O3LogLevel asyncSendLevel = O3LogLevel::Info;
+  size_t asyncWriteIndex = 0;                // Where the line being built continues
+  size_t asyncLineStart = 0;                 // Position of the length field of the line being built
+  size_t asyncLineLength = 0;
+  bool asyncLineOpen = false;
+  bool asyncLineDropped = false;
+  volatile bool asyncPumping = false;
+
+  // Disables interrupts for a few instructions so index updates are not torn on 8-bit MCUs.
+  // The previous state is restored, not just switched on, because pump() may run in a timer ISR
+  // or be called by code that already disabled interrupts.
+  struct InterruptGuard {
+#if defined(__AVR__)
+    uint8_t savedSreg;
+    InterruptGuard() : savedSreg(SREG) { cli(); }
+    ~InterruptGuard() { SREG = savedSreg; }
+#elif defined(ARDUINO_ARCH_ESP32)
+    // A spinlock critical section also keeps the other core out, _SAFE works in ISRs and tasks.
+    static inline portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+    InterruptGuard() { portENTER_CRITICAL_SAFE(&lock); }
+    ~InterruptGuard() { portEXIT_CRITICAL_SAFE(&lock); }
+#elif defined(ARDUINO_ARCH_ESP8266)
+    uint32_t savedPs;
+    InterruptGuard() : savedPs(xt_rsil(15)) {}
+    ~InterruptGuard() { xt_wsr_ps(savedPs); }
+#elif defined(__ARM_ARCH_PROFILE) && __ARM_ARCH_PROFILE == 'M'
+    // Cortex-M (RP2040, SAMD, STM32, nRF52, Teensy): PRIMASK is 1 while interrupts are off.
+    // Written in assembly because not every core includes the CMSIS __get_PRIMASK().
+    uint32_t savedPrimask;
+    InterruptGuard() {
+      __asm__ volatile("mrs %0, primask" : "=r"(savedPrimask));
+      __asm__ volatile("cpsid i" ::: "memory");
+    }
+    ~InterruptGuard() { __asm__ volatile("msr primask, %0" : : "r"(savedPrimask) : "memory"); }
+#else
+    InterruptGuard() { noInterrupts(); }
+    ~InterruptGuard() { interrupts(); }
+#endif
+  };
+
+  static constexpr size_t asyncLineHeaderSize = 3;
+
+  static size_t asyncIndex(size_t index) { return index % asyncBufferSize; }
+  uint8_t asyncByteAt(size_t index) const { return asyncBuffer[asyncIndex(index)]; }
+
+  // Only one pump() at a time, for example loop() and a timer ISR both calling it.
+  bool claimPump() {
+    InterruptGuard guard;
+    if (asyncPumping) return false;
+    asyncPumping = true;
+    return true;
   }
 
-  void copyPartSeparator(const char* value) {
-    if (!value || value[0] == '\0') value = " ";
+  // Body of pump(), also used by the Block policy while a log call already holds the lock.
+  size_t pumpQueued(size_t maxBytes) {
+    if (!out || !claimPump()) return 0;
+    size_t sent = 0;
+    while (sent < maxBytes) {
+      if (asyncSendRemaining == 0) {
+        size_t head;
+        {
+          InterruptGuard guard;
+          head = asyncHead;
+        }
+        if (asyncTail == head) break;
+        // Each queued line starts with its 16-bit length and its level.
+        const size_t length = asyncByteAt(asyncTail) | (static_cast<size_t>(asyncByteAt(asyncTail + 1)) << 8);
+        asyncSendLevel = static_cast<O3LogLevel>(asyncByteAt(asyncTail + 2));
+        InterruptGuard guard;
+        asyncTail = asyncIndex(asyncTail + asyncLineHeaderSize);
+        asyncSendRemaining = length;
+        asyncSendAhead = 0;
+        continue;
+      }
+      size_t chunk = asyncBufferSize - asyncTail;
+      if (chunk > asyncSendRemaining) chunk = asyncSendRemaining;
+      if (chunk > maxBytes - sent) chunk = maxBytes - sent;
+      // Only the first output's progress moves asyncTail. If it took part of the chunk, the others
+      // already have all of it and skip those bytes when pump() offers them again.
+      const size_t skip = asyncSendAhead < chunk ? asyncSendAhead : chunk;
+      const size_t written = writeToSinks(asyncSendLevel, asyncBuffer + asyncTail, chunk, skip);
+      asyncSendAhead = (asyncSendAhead > chunk ? asyncSendAhead : chunk) - written;
+      {
+        InterruptGuard guard;
+        asyncTail = asyncIndex(asyncTail + written);
+      }
+      asyncSendRemaining -= written;
+      sent += written;
+      if (asyncSendRemaining == 0) {
+#if O3_LOG_STATS
+        statsLineDone();
+#endif
+        sinksLineDone();
+      }
+      if (written < chunk) break;
+    }
+    asyncPumping = false;
+    return sent;
+  }
+
+  size_t asyncFreeBytes() const {
+    size_t tail;
+    {
+      InterruptGuard guard;
+      tail = asyncTail;
+    }
+    return asyncBufferSize - 1 - asyncIndex(asyncWriteIndex + asyncBufferSize - tail);
+  }
+
+  // Removes the oldest queued line that pump() has not started yet. Returns false if there is none.
+  bool asyncDropOldest() {
+    InterruptGuard guard;
+    if (asyncPumping || asyncSendRemaining > 0 || asyncTail == asyncHead) return false;
+    const size_t length = asyncByteAt(asyncTail) | (static_cast<size_t>(asyncByteAt(asyncTail + 1)) << 8);
+    asyncTail = asyncIndex(asyncTail + asyncLineHeaderSize + length);
+    droppedLineCount++;
+    return true;
+  }
+
+  // Makes room for size more bytes according to overflowPolicy.
+  bool asyncReserve(size_t size) {
+    // A line that can never fit is dropped whatever the policy is.
+    if (asyncLineLength + size + asyncLineHeaderSize > asyncBufferSize - 1 || asyncLineLength + size > 0xFFFF) return false;
+    while (asyncFreeBytes() < size) {
+      if (overflowPolicy == O3OverflowPolicy::DropOldest) {
+        if (!asyncDropOldest()) return false;
+      } else if (overflowPolicy == O3OverflowPolicy::Block) {
+        if (pumpQueued(size - asyncFreeBytes()) == 0) return false;
+      } else {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void asyncAppend(O3LogLevel level, const uint8_t* data, size_t size) {
+    if (!asyncLineOpen) {
+      asyncLineOpen = true;
+      asyncLineDropped = false;
+      asyncLineLength = 0;
+      asyncLineStart = asyncWriteIndex;
+      if (!asyncReserve(asyncLineHeaderSize)) {
+        asyncLineDropped = true;
+        return;
+      }
+      asyncBuffer[asyncIndex(asyncLineStart + 2)] = static_cast<uint8_t>(level);
+      asyncWriteIndex = asyncIndex(asyncWriteIndex + asyncLineHeaderSize);
+    }
+    if (asyncLineDropped) return;
+    if (!asyncReserve(size)) {
+      asyncLineDropped = true;
+      asyncWriteIndex = asyncLineStart;
+      return;
+    }
+    while (size > 0) {
+      size_t chunk = asyncBufferSize - asyncWriteIndex;
+      if (chunk > size) chunk = size;
+      memcpy(asyncBuffer + asyncWriteIndex, data, chunk);
+      asyncWriteIndex = asyncIndex(asyncWriteIndex + chunk);
+      asyncLineLength += chunk;
+      data += chunk;
+      size -= chunk;
+    }
+#if O3_LOG_STATS
+    const uint32_t used = static_cast<uint32_t>(asyncBufferSize - 1 - asyncFreeBytes());
+    if (used > statsData.asyncHighWater) statsData.asyncHighWater = used;
+#endif
+  }
+
+  // Publishes the finished line so pump() can send it.
+  void asyncFinish() {
+    if (!asyncLineOpen) return;
+    asyncLineOpen = false;
+    if (asyncLineDropped) {
+      droppedLineCount++;
+      return;
+    }
+    asyncBuffer[asyncLineStart] = static_cast<uint8_t>(asyncLineLength & 0xFF);
+    asyncBuffer[asyncIndex(asyncLineStart + 1)] = static_cast<uint8_t>(asyncLineLength >> 8);
+    InterruptGuard guard;
+    asyncHead = asyncWriteIndex;
+  }
+#endif
+
+  // Every byte of formatted output ends up here, either straight to the outputs or into the ring.
+  void deliver(O3LogLevel level, const uint8_t* data, size_t size) {
+#if O3_LOG_ASYNC_BUFFER_SIZE > 0
+    asyncAppend(level, data, size);
+#else
+    writeToSinks(level, data, size);
+#endif
+  }
+
+  static bool sinkAccepts(O3LogLevel sinkLevel, O3LogLevel level) {
+    return sinkLevel != O3LogLevel::None && static_cast<uint8_t>(level) >= static_cast<uint8_t>(sinkLevel);
+  }
+
+  // Writes to every output that accepts level. Returns what the first of them took
+  // (pump() uses it to track progress), or size if none wants these bytes.
+  // The other outputs got the first skip bytes already and are only given the rest.
+  size_t writeToSinks(O3LogLevel level, const uint8_t* data, size_t size, size_t skip = 0) {
+#if O3_LOG_STATS
+    const uint32_t started = micros();
+#endif
+    size_t written = size;
+    bool first = true;
+    if (sinkAccepts(minLevel, level)) {
+      written = out->write(data, size);
+      first = false;
+      if (sinkAccepts(outFlushLevel, level)) outFlushDue = sinkLineWork = true;
+    }
+    for (size_t i = 0; i < extraSinkCount; i++) {
+      Sink& sink = *sinkSlot(i);
+      if (!sink.stream || !sinkAccepts(sink.minLevel, level)) continue;
+      const size_t offset = first ? 0 : skip;
+      if (sink.lineSink && !sink.inLine) {
+        sink.lineSink->beginLine(level);
+        sink.inLine = sinkLineWork = true;
+      }
+      const size_t taken = offset < size ? sink.stream->write(data + offset, size - offset) : 0;
+      if (first) written = taken;
+      first = false;
+      if (sinkAccepts(sink.flushLevel, level)) sink.flushDue = sinkLineWork = true;
+    }
+#if O3_LOG_STATS
+    const uint32_t elapsed = micros() - started;
+    statsData.writeMicros += elapsed;
+    lineWriteMicros += elapsed;
+    statsData.bytesWritten += written;
+#endif
+    return written;
+  }
+
+  // Sink levels are matched by stream, an output removed since the snapshot is skipped.
+  // Tag slots never change, their levels are copied by index.
+  void restoreOutputLevels(const O3LogProfile& profile) {
+    outFlushLevel = profile.outFlushLevel;
+#if O3_LOG_MAX_SINKS > 1
+    for (size_t i = 0; i < extraSinkCount; i++) {
+      if (!profile.sinks[i]) continue;
+      const int index = findSink(*profile.sinks[i]);
+      if (index < 0) continue;
+      extraSinks[index].minLevel = profile.sinkMinLevels[i];
+      extraSinks[index].flushLevel = profile.sinkFlushLevels[i];
+    }
+#endif
+#if O3_LOG_MAX_TAGS > 0
+    for (size_t i = 0; i < tagCount; i++) tags[i].minLevel = profile.tagMinLevels[i];
+#endif
+  }
+
+  int findSink(const Print& sink) const {
+    for (size_t i = 0; i < extraSinkCount; i++) {
+      if (sinkSlot(i)->stream == &sink) return static_cast<int>(i);
+    }
+    return -1;
+  }
+
+  void updateLowestLevel() {
+    lowestLevel = minLevel;
+    for (size_t i = 0; i < extraSinkCount; i++) {
+      const Sink& sink = *sinkSlot(i);
+      if (sink.stream && static_cast<uint8_t>(sink.minLevel) < static_cast<uint8_t>(lowestLevel)) {
+        lowestLevel = sink.minLevel;
+      }
+    }
+#if O3_LOG_PERSIST_BUFFER_SIZE > 0
+    outputLevel = lowestLevel;
+    if (persistLog && static_cast<uint8_t>(persistLevel) < static_cast<uint8_t>(lowestLevel)) lowestLevel = persistLevel;
+#endif
+  }
+
+  // Called once a line is complete (after its newline was delivered).
+  void finishRecord() {
+#if O3_LOG_ASYNC_BUFFER_SIZE > 0
+    asyncFinish();
+#else
+#if O3_LOG_STATS
+    statsLineDone();
+#endif
+    sinksLineDone();
+#endif
+  }
+
+  // A line has been written completely: ends it on the line sinks and flushes the outputs
+  // it reached a flushLevel on, see setSinkFlushLevel().
+  void sinksLineDone() {
+    if (!sinkLineWork) return;
+    sinkLineWork = false;
+    if (outFlushDue) {
+      outFlushDue = false;
+      out->flush();
+    }
+    for (size_t i = 0; i < extraSinkCount; i++) {
+      Sink& sink = *sinkSlot(i);
+      if (sink.inLine) {
+        sink.inLine = false;
+        sink.lineSink->endLine();
+      }
+      if (sink.flushDue) {
+        sink.flushDue = false;
+        if (sink.stream) sink.stream->flush();
+      }
+    }
+  }
+
+#if O3_LOG_STATS
+  // A line has left through the outputs (at the end of the log call, or in pump() in async mode).
+  void statsLineDone() {
+    statsData.linesWritten++;
+    if (lineWriteMicros > statsData.longestLineMicros) statsData.longestLineMicros = lineWriteMicros;
+    lineWriteMicros = 0;
+  }
+#endif
+
+  // Terminates the current line and resets the header state.
+  void endLine(LineWriter& line) {
+    line.println();
+    line.commit();
+    finishRecord();
+    resetLineState();
+  }
+
+  // Safe copy into fixed-size buffer (always null-terminated), rendered as "[...] ".
+  void copyPrefix(const char* value) { prefixLength = O3LogProfile::renderPrefix(prefixBuffer, value); }
+
+  // Wraps the prefix text (already at prefixBuffer + 1) into "[...] ".
+  void renderPrefix(size_t length) {
+    prefixLength = static_cast<uint8_t>(length);
+    O3LogProfile::wrapPrefix(prefixBuffer, length);
+  }
+
+  // Returns the id of the tag called name (a RAM copy of length bytes), adds it if it is new.
+  // 0 if all slots are taken. source is the pointer a new tag keeps.
+  uint8_t findOrAddTag(const char* source, bool flashSource, const char* name, size_t length) {
+    if (tagCount == 0 || length == 0) return 0;
+    for (size_t i = 0; i < tagCount; i++) {
+      Tag& entry = *tagSlot(i);
+      if (!entry.name) {
+        entry.name = source;
+        entry.length = static_cast<uint8_t>(length);
+        entry.flashName = flashSource;
+        entry.minLevel = O3LogLevel::Debug;
+        return static_cast<uint8_t>(i + 1);
+      }
+      char existing[prefixMaxLen];
+      if (tagName(static_cast<uint8_t>(i + 1), existing) == length && memcmp(existing, name, length) == 0) {
+        return static_cast<uint8_t>(i + 1);
+      }
+    }
+    return 0;
+  }
+
+  // Copies the name of tag id into target (prefixMaxLen bytes), returns its length.
+  size_t tagName(uint8_t id, char* target) const {
+    if (id == 0 || id > tagCount) return 0;
+    const Tag& entry = *tagSlot(id - 1);
+    if (entry.flashName) {
+      memcpy_P(target, entry.name, entry.length);
+    } else {
+      memcpy(target, entry.name, entry.length);
+    }
+    return entry.length;
+  }
+
+  // "[MQTT] " in one block write. A replayed record can carry a tag that is not registered (yet)
+  // after a reboot, it is shown by its number: "[#2] ".
+  void writeTagPrefix(Print& line, uint8_t id) {
+    char text[prefixMaxLen + 3];
+    size_t length = tagName(id, text + 1);
+    if (length == 0) {
+      text[1] = '#';
+      length = 1 + O3Format::formatUnsigned(text + 2, id);
+    }
+    text[0] = '[';
+    text[length + 1] = ']';
+    text[length + 2] = ' ';
+    line.write(reinterpret_cast<const uint8_t*>(text), length + 3);
+  }
+
+  bool tagAccepts(uint8_t id, O3LogLevel level) const {
+    if (id == 0 || id > tagCount) return true;
+    return sinkAccepts(tagSlot(id - 1)->minLevel, level);
+  }
+
+  // ---------------------------------------------------------------------------
+  // Command parsing, see handleCommand()
+  // ---------------------------------------------------------------------------
+
+  // Skips spaces, returns the next word (word, length) and moves text behind it.
+  static size_t nextWord(const char*& text, const char*& word) {
+    while (*text == ' ' || *text == '\t') text++;
+    word = text;
+    while (*text != '\0' && *text != ' ' && *text != '\t') text++;
+    return static_cast<size_t>(text - word);
+  }
+
+  static char lowerCase(char c) { return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c; }
+
+  static bool wordIs(const char* word, size_t length, const char* expected, size_t expectedLength) {
+    if (length != expectedLength || length == 0) return false;
+    for (size_t i = 0; i < length; i++) {
+      if (lowerCase(word[i]) != lowerCase(expected[i])) return false;
+    }
+    return true;
+  }
+
+  static bool wordIs(const char* word, size_t length, const char* expected) { return wordIs(word, length, expected, strlen(expected)); }
+
+  static bool parseLevel(const char* word, size_t length, O3LogLevel& level) {
+    static const O3LogLevel levels[] = { O3LogLevel::Debug, O3LogLevel::Info, O3LogLevel::Warn, O3LogLevel::Error };
+    for (O3LogLevel candidate : levels) {
+      char text[maxLevelTextLength + 1];
+      copyFlash(text, sizeof(text), levelText(candidate));
+      if (wordIs(word, length, text)) {
+        level = candidate;
+        return true;
+      }
+    }
+    if (!wordIs(word, length, "none")) return false;
+    level = O3LogLevel::None;
+    return true;
+  }
+
+  uint8_t findTagIgnoreCase(const char* name, size_t length) const {
+    for (size_t i = 0; i < tagCount && tagSlot(i)->name; i++) {
+      char text[prefixMaxLen];
+      const size_t textLength = tagName(static_cast<uint8_t>(i + 1), text);
+      if (wordIs(name, length, text, textLength)) return static_cast<uint8_t>(i + 1);
+    }
+    return 0;
+  }
+
+  // "lvl APP=INFO NET=DEBUG MQTT=WARN". Level None reaches every output, like the answer of a shell.
+  void writeLevels() {
+    if (!commandAnswerPossible()) return;
+    LineWriter line(*this, O3LogLevel::None);
+    beginLine(line, O3LogLevel::None);
+    writeFlash(line, F("lvl "));
+    if (prefixLength > 0) {
+      line.write(reinterpret_cast<const uint8_t*>(prefixBuffer + 1), prefixLength);
+    } else {
+      line.write('-');
+    }
+    line.write('=');
+    writeFlash(line, levelName(minLevel));
+    for (size_t i = 0; i < tagCount && tagSlot(i)->name; i++) {
+      char text[prefixMaxLen];
+      line.write(' ');
+      line.write(reinterpret_cast<const uint8_t*>(text), tagName(static_cast<uint8_t>(i + 1), text));
+      line.write('=');
+      writeFlash(line, levelName(tagSlot(i)->minLevel));
+    }
+    finishLine(line);
+  }
+
+  void writeCommandNote(const __FlashStringHelper* message, const char* word, size_t length) {
+    if (!commandAnswerPossible()) return;
+    LineWriter line(*this, O3LogLevel::None);
+    beginLine(line, O3LogLevel::None);
+    writeFlash(line, message);
+    if (word) line.write(reinterpret_cast<const uint8_t*>(word), length);
+    finishLine(line);
+  }
+
+  // Answers are text, a binary stream only gets the new levels.
+  bool commandAnswerPossible() const { return enabled && out && format != O3LogFormat::Binary; }
+
+  static const __FlashStringHelper* levelName(O3LogLevel level) {
+    return level == O3LogLevel::None ? F("NONE") : levelText(level);
+  }
+
+  void copyPartSeparator(const char* value) { O3LogProfile::renderSeparator(partSeparatorBuffer, value); }
+
+  // Same as above, reading the source byte by byte from flash.
+  static size_t copyFlash(char* target, size_t capacity, const __FlashStringHelper* value) {
+    const char* text = reinterpret_cast<const char*>(value);
     size_t i = 0;
-    for (; i + 1 < partSepMaxLen && value[i] != '\0'; i++) {
-      partSeparatorBuffer[i] = value[i];
+    if (text) {
+      for (; i + 1 < capacity; i++) {
+        const char c = static_cast<char>(pgm_read_byte(text + i));
+        if (c == '\0') break;
+        target[i] = c;
+      }
+    }
+    target[i] = '\0';
+    return i;
+  }
+
+  void copyPrefix(const __FlashStringHelper* value) { renderPrefix(copyFlash(prefixBuffer + 1, prefixMaxLen, value)); }
+
+  void copyPartSeparator(const __FlashStringHelper* value) {
+    if (copyFlash(partSeparatorBuffer, partSepMaxLen, value) == 0) copyPartSeparator(" ");
+  }
+
+  // Writes a flash string in blocks. Print::print(F(...)) calls write() once per character.
+  static void writeFlash(Print& line, const __FlashStringHelper* value) {
+    const char* text = reinterpret_cast<const char*>(value);
+    if (!text) return;
+    writeFlash(line, text, strlen_P(text));
+  }
+
+  // The first length bytes of a flash string.
+  static void writeFlash(Print& line, const char* text, size_t remaining) {
+    uint8_t chunk[16];
+    while (remaining > 0) {
+      const size_t size = remaining < sizeof(chunk) ? remaining : sizeof(chunk);
+      memcpy_P(chunk, text, size);
+      line.write(chunk, size);
+      text += size;
+      remaining -= size;
     }
-    partSeparatorBuffer[i] = '\0';
   }
 
   void resetLineState() {
     lineOpen = false;
     activeLevel = defaultLevel;
+    activeTag = 0;
+  }
+
+  // Picks the timestamp functions once, so writeHeader() does not branch on the source per line.
+  void configureTimestamp(O3TimestampSource source, uint32_t (*newEpochSource)()) {
+    timestampSource = source;
+    epochSource = newEpochSource;
+    formatTimestamp = formatCounter;
+    switch (timestampSource) {
+      case O3TimestampSource::Micros:      readTimestamp = readMicros; break;
+      case O3TimestampSource::DeltaMillis: readTimestamp = readDeltaMillis; previousTimestamp = millis(); break;
+      case O3TimestampSource::DeltaMicros: readTimestamp = readDeltaMicros; previousTimestamp = micros(); break;
+      case O3TimestampSource::Epoch:
+        readTimestamp = readEpochMillis;
+        formatTimestamp = formatEpoch;
+        if (epochSource) {
+          epochSeconds = epochSource();
+          epochMillis = millis();
+        }
+        break;
+      default: readTimestamp = readMillis; break;
+    }
+  }
+
+  static uint32_t readMillis(O3SerialWriter&) { return millis(); }
+  static uint32_t readMicros(O3SerialWriter&) { return micros(); }
+
+  static uint32_t readDeltaMillis(O3SerialWriter& writer) {
+    const uint32_t now = millis();
+    const uint32_t delta = now - writer.previousTimestamp;
+    writer.previousTimestamp = now;
+    return delta;
+  }
+
+  static uint32_t readDeltaMicros(O3SerialWriter& writer) {
+    const uint32_t now = micros();
+    const uint32_t delta = now - writer.previousTimestamp;
+    writer.previousTimestamp = now;
+    return delta;
+  }
+
+  // Milliseconds since epochSeconds, binary records send this (the settings record has the seconds).
+  static uint32_t readEpochMillis(O3SerialWriter& writer) { return millis() - writer.epochMillis; }
+
+  static size_t formatCounter(O3SerialWriter& writer, char* target) {
+    return O3Format::formatUnsignedPadded(target, writer.readTimestamp(writer), writer.millisWidth);
+  }
+
+  static size_t formatEpoch(O3SerialWriter& writer, char* target) {
+    const uint32_t elapsed = readEpochMillis(writer);
+    return formatEpochText(target, writer.epochSeconds + elapsed / 1000, elapsed % 1000);
+  }
+
+  static size_t formatEpochText(char* target, uint32_t seconds, uint32_t milliseconds) {
+    size_t length = O3Format::formatUnsigned(target, seconds);
+    target[length++] = '.';
+    return length + O3Format::formatUnsignedPadded(target + length, milliseconds, 3);
+  }
+
+  static constexpr size_t maxTimestampChars = O3Format::maxUnsignedDigits + 4; // "4294967295.999"
+
+  static const __FlashStringHelper* timestampText(O3TimestampSource source) {
+    switch (source) {
+      case O3TimestampSource::Micros:      return F("micros");
+      case O3TimestampSource::DeltaMillis: return F("deltaMillis");
+      case O3TimestampSource::DeltaMicros: return F("deltaMicros");
+      case O3TimestampSource::Epoch:       return F("epoch");
+      default:                             return F("millis");
+    }
   }
 
   // Central filter logic: if this returns false, we do not print anything.
-  bool canWrite(O3LogLevel level) const {
-    if (!enabled) return false;
-    if (!out) return false;
-    if (minLevel == O3LogLevel::None) return false;
-    return static_cast<uint8_t>(level) >= static_cast<uint8_t>(minLevel);
+  bool canWrite(O3LogLevel level) {
+    if (!o3LogLevelCompiledIn(level)) return false;
+    if (enabled && out && sinkAccepts(lowestLevel, level)) return true;
+#if O3_LOG_STATS
+    {
+      // No line holds the lock yet, other tasks may be counting at the same time.
+#if O3_LOG_THREAD_SAFE
+      LockGuard guard(mutex);
+#endif
+      statsData.linesFiltered++;
+    }
+#endif
+    return false;
   }
 
-  const char* levelText(O3LogLevel level) const {
+  // Level names live in flash (PROGMEM), on AVR this keeps them out of SRAM.
+  static const __FlashStringHelper* levelText(O3LogLevel level) {
     switch (level) {
-      case O3LogLevel::Debug: return "DEBUG";
-      case O3LogLevel::Info:  return "INFO";
-      case O3LogLevel::Warn:  return "WARN";
-      case O3LogLevel::Error: return "ERROR";
-      default:                return "LOG";
+      case O3LogLevel::Debug: return F("DEBUG");
+      case O3LogLevel::Info:  return F("INFO");
+      case O3LogLevel::Warn:  return F("WARN");
+      case O3LogLevel::Error: return F("ERROR");
+      default:                return F("LOG");
+    }
+  }
+
+  static const __FlashStringHelper* overflowPolicyText(O3OverflowPolicy policy) {
+    switch (policy) {
+      case O3OverflowPolicy::DropOldest: return F("dropOldest");
+      case O3OverflowPolicy::Block:      return F("block");
+      default:                           return F("dropNewest");
     }
   }
 
   // Writes header once per line:
   // Example output:
   //   [NET] 12345 INFO: <your message here>
-  void writeHeader(O3LogLevel level) {
-    if (prefixBuffer[0] != '\0') {
-      out->print('[');
-      out->print(prefixBuffer);
-      out->print("] ");
-    }
+  //
+  // At most two block writes: the pre-rendered "[NET] ", then timestamp and level,
+  // which are composed in a small stack buffer.
+  void writeHeader(LineWriter& line, O3LogLevel level) {
+    char tail[headerTailSize];
+    size_t length = 0;
 
     if (showMillis) {
-      out->print(millis());
-      out->print(' ');
+      length = formatTimestamp(*this, tail);
+      tail[length++] = ' ';
+    }
+
+    writeHeader(line, level, tail, length);
+  }
+
+  // Rest of the header, tail already holds the timestamp (length bytes). dumpPersisted() passes
+  // the stored timestamp here.
+  void writeHeader(LineWriter& line, O3LogLevel level, char* tail, size_t length) {
+    if (line.tag > 0) {
+      writeTagPrefix(line, line.tag);
+    } else if (prefixLength > 0) {
+      line.write(reinterpret_cast<const uint8_t*>(prefixBuffer), prefixLength + 3);
     }
 
     if (showLevel) {
-      out->print(levelText(level));
-      out->print(": ");
+      const char* text = reinterpret_cast<const char*>(levelText(level));
+      const size_t textLength = strlen_P(text);
+      memcpy_P(tail + length, text, textLength);
+      length += textLength;
+      tail[length++] = ':';
+      tail[length++] = ' ';
     }
+
+    if (length > 0) line.write(reinterpret_cast<const uint8_t*>(tail), length);
   }
 
+  static constexpr size_t fillChunkSize = 32;
+  static constexpr size_t maxLevelTextLength = 5; // "DEBUG", "ERROR"
+  static constexpr size_t headerTailSize = maxTimestampChars + 1 + maxLevelTextLength + 2;
+
   // Ensures the header is printed exactly once for a given line.
   // If we were already building a line and the caller changes log level,
   // we finish the old line and start a new one.
-  void ensureLineHeader(O3LogLevel level) {
+  void ensureLineHeader(LineWriter& line, O3LogLevel level) {
+    line.level = level;
     if (!lineOpen) {
       activeLevel = level;
-      writeHeader(level);
+      activeTag = line.tag;
+      writeHeader(line, level);
       lineOpen = true;
       return;
     }
 
-    if (level != activeLevel) {
-      out->println();
-      resetLineState();
+    if (level != activeLevel || line.tag != activeTag) {
+      line.level = activeLevel;
+      endLine(line);
+      line.level = level;
       activeLevel = level;
-      writeHeader(level);
+      activeTag = line.tag;
+      writeHeader(line, level);
       lineOpen = true;
     }
   }
 
-  // Single message printing.
-  void line(O3LogLevel level, const char* message) {
-    if (!canWrite(level)) return;
-    ensureLineHeader(level);
-    out->println(message);
-    resetLineState();
+  // Header of a complete line written by one call (debug()/info()/..., drawLine(), printOptions()).
+  // In thread-safe mode such a line never joins a print() chain, the shared chain state belongs to
+  // whichever task holds the lock.
+  void beginLine(LineWriter& line, O3LogLevel level) {
+#if O3_LOG_THREAD_SAFE
+    line.level = level;
+    writeHeader(line, level);
+#else
+    ensureLineHeader(line, level);
+#endif
+  }
+
+  void finishLine(LineWriter& line) {
+#if O3_LOG_THREAD_SAFE
+    line.println();
+    line.commit();
+    finishRecord();
+#else
+    endLine(line);
+#endif
+  }
+
+  // Single message printing (const char* or F("...")). tag is 0 for the writer's own lines.
+  template <typename Message>
+  void line(O3LogLevel level, uint8_t tag, Message message) {
+    if (!canWrite(level) || !tagAccepts(tag, level) || !admitLine(level, tag, 0, message)) return;
+    writeLine(level, tag, 0, message);
   }
 
-  // Print one "part". Arduino's Stream::print supports many types (const char*, int, long, float, etc.).
+  // Print one "part". Arduino's Print::print supports many types (const char*, int, long, float, etc.).
+  // Lazy parts (lambdas) are called here and their result is printed like any other part.
+  // Printable objects print themselves straight into the line.
   template <typename T>
-  void writePart(const T& value) {
-    out->print(value);
+  void writePart(Print& line, const T& value) {
+    if constexpr (O3IsLazyPart<T>::value) {
+      writePart(line, value());
+    } else if constexpr (O3IsPrintable<T>::value) {
+      value.printTo(line);
+    } else {
+      line.print(value);
+    }
   }
 
-  // Recursive variadic printer:
-  // - prints the first part
-  // - if there are remaining parts, prints separator then prints the rest
+  void writePart(Print& line, const __FlashStringHelper* value) { writeFlash(line, value); }
+
+  // Text with a known length goes out in one write, without strlen().
+  void writePart(Print& line, const O3Span& value) {
+    if (value.data) line.write(reinterpret_cast<const uint8_t*>(value.data), value.length);
+  }
+  void writePart(Print& line, const String& value) {
+    line.write(reinterpret_cast<const uint8_t*>(value.c_str()), value.length());
+  }
+
+  template <typename Key, typename Value>
+  void writePart(Print& line, const O3KeyValue<Key, Value>& part) {
+    writePart(line, part.key);
+    line.write('=');
+    writePart(line, part.value);
+  }
+
+  // Integers go through O3Format instead of Print's digit-by-digit path.
+  // char is not in this list on purpose, it prints as a character.
+  void writePart(Print& line, unsigned char value)      { writeUnsignedText(line, value); }
+  void writePart(Print& line, short value)              { writeSignedText(line, value); }
+  void writePart(Print& line, unsigned short value)     { writeUnsignedText(line, value); }
+  void writePart(Print& line, int value)                { writeSignedText(line, value); }
+  void writePart(Print& line, unsigned int value)       { writeUnsignedText(line, value); }
+  void writePart(Print& line, long value)               { writeSignedText(line, value); }
+  void writePart(Print& line, unsigned long value)      { writeUnsignedText(line, value); }
+  void writePart(Print& line, long long value)          { writeSignedText(line, value); }
+  void writePart(Print& line, unsigned long long value) { writeUnsignedText(line, value); }
+
+  // Floats too, Print's float path calls write() once per digit.
+  void writePart(Print& line, float value)  { writeFixedText(line, value, 2); }
+  void writePart(Print& line, double value) { writeFixedText(line, value, 2); }
+
+  template <typename T>
+  void writePart(Print& line, const O3Fixed<T>& part) { writeFixedText(line, part.value, part.decimals); }
+
+  template <typename T>
+  static void writeFixedText(Print& line, T value, uint8_t decimals) {
+    char text[O3Format::maxFixedChars];
+    const size_t length = O3Format::formatFixed(text, value, decimals);
+    line.write(reinterpret_cast<const uint8_t*>(text), length);
+  }
+
+  // 64-bit math only for types that need it (long long, or long on 64-bit hosts).
+  template <typename T>
+  static void writeSignedText(Print& line, T value) {
+    char text[O3Format::maxSigned64Chars];
+    size_t length;
+    if constexpr (sizeof(T) > 4) {
+      length = O3Format::formatSigned64(text, static_cast<int64_t>(value));
+    } else {
+      length = O3Format::formatSigned(text, static_cast<int32_t>(value));
+    }
+    line.write(reinterpret_cast<const uint8_t*>(text), length);
+  }
+
+  template <typename T>
+  static void writeUnsignedText(Print& line, T value) {
+    char text[O3Format::maxUnsigned64Digits];
+    size_t length;
+    if constexpr (sizeof(T) > 4) {
+      length = O3Format::formatUnsigned64(text, static_cast<uint64_t>(value));
+    } else {
+      length = O3Format::formatUnsigned(text, static_cast<uint32_t>(value));
+    }
+    line.write(reinterpret_cast<const uint8_t*>(text), length);
+  }
+
+  // count copies of character, written in blocks of up to fillChunkSize bytes instead of
+  // one write() per character. Used by fill(), drawLine() and the printf padding.
+  static void writeFill(Print& line, char character, size_t count) {
+    uint8_t chunk[fillChunkSize];
+    memset(chunk, character, count < sizeof(chunk) ? count : sizeof(chunk));
+    while (count > 0) {
+      const size_t size = count < sizeof(chunk) ? count : sizeof(chunk);
+      line.write(chunk, size);
+      count -= size;
+    }
+  }
+
+  // ---------------------------------------------------------------------------
+  // printf-style formatting, see infof()
   //
-  // if constexpr is a compile-time if. It only compiles the branch that is needed.
-  template <typename First, typename... Rest>
-  void writeParts(const First& first, const Rest&... rest) {
-    writePart(first);
-    if constexpr (sizeof...(rest) > 0) {
-      out->print(partSeparatorBuffer);
-      writeParts(rest...);
+  // The line gets one Printable part that formats into the line when it is printed, so the text
+  // goes straight into the line buffer and Json/Logfmt/Binary output treat it as one text part.
+  // ---------------------------------------------------------------------------
+
+  template <typename Render>
+  class FormattedPart : public Printable {
+  public:
+    explicit FormattedPart(const Render& function) : render(function) {}
+    size_t printTo(Print& line) const override {
+      render(line);
+      return 0;
+    }
+
+  private:
+    const Render& render;
+  };
+
+  // Position in a RAM or flash format string.
+  struct FormatCursor {
+    const char* p;
+    bool flash;
+    char peek() const { return flash ? static_cast<char>(pgm_read_byte(p)) : *p; }
+  };
+
+  struct FormatSpec {
+    const char* start = nullptr; // The '%', to print a conversion that has no argument
+    char conversion = '\0';
+    bool left = false;
+    bool zero = false;
+    bool plus = false;
+    bool space = false;
+    bool alternate = false;
+    uint8_t width = 0;
+    int8_t precision = -1;
+  };
+
+  static constexpr uint8_t maxFormatWidth = 64;
+
+  template <typename... Args>
+  void formatLine(O3LogLevel level, uint8_t tag, const char* text, const Args&... args) {
+    formatLine(level, tag, FormatCursor{ text, false }, text, args...);
+  }
+
+  template <typename... Args>
+  void formatLine(O3LogLevel level, uint8_t tag, const __FlashStringHelper* text, const Args&... args) {
+    formatLine(level, tag, FormatCursor{ reinterpret_cast<const char*>(text), true }, text, args...);
+  }
+
+  template <typename Text, typename... Args>
+  void formatLine(O3LogLevel level, uint8_t tag, O3FormatString<Text>, const Args&... args) {
+    static_assert(o3FormatMatches<Args...>(Text::value()), "O3_FMT format string does not match the arguments");
+    formatLine(level, tag, FormatCursor{ Text::value(), false }, Text::value(), args...);
+  }
+
+  // text is passed on as it is for the rate limiter, it hashes the text, not the pointer.
+  template <typename Format, typename... Args>
+  void formatLine(O3LogLevel level, uint8_t tag, FormatCursor cursor, const Format& text, const Args&... args) {
+    if (!cursor.p || !canWrite(level) || !tagAccepts(tag, level) || !admitLine(level, tag, 0, text, args...)) return;
+#if O3_LOG_PERSIST_BUFFER_SIZE > 0
+    // The line is rendered for the crash log and again for the outputs, lazy arguments are called once.
+    if constexpr ((false || ... || O3IsLazyPart<Args>::value)) {
+      writeFormattedLine(level, tag, cursor, callLazy(args)...);
+      return;
+    }
+#endif
+    writeFormattedLine(level, tag, cursor, args...);
+  }
+
+  template <typename... Args>
+  void writeFormattedLine(O3LogLevel level, uint8_t tag, FormatCursor cursor, const Args&... args) {
+    auto render = [&](Print& line) {
+      FormatCursor position = cursor;
+      writeFormatted(line, position, args...);
+    };
+    writeLine(level, tag, 0, FormattedPart<decltype(render)>(render));
+  }
+
+  template <typename... Args>
+  void writeFormatted(Print& line, FormatCursor& cursor, const Args&... args) {
+    FormatSpec spec;
+    if constexpr (sizeof...(args) > 0) {
+      if (nextFormatSpec(line, cursor, spec)) {
+        writeFormattedArgument(line, cursor, spec, args...);
+        return;
+      }
     }
+    // Arguments are used up: the rest is text, conversions included.
+    while (nextFormatSpec(line, cursor, spec)) writeFormatRange(line, cursor.flash, spec.start, cursor.p);
   }
 
-  // Variadic log: prints all parts in one line.
   template <typename First, typename... Rest>
-  void parts(O3LogLevel level, const First& first, const Rest&... rest) {
-    if (!canWrite(level)) return;
-    ensureLineHeader(level);
-    writeParts(first, rest...);
-    out->println();
-    resetLineState();
+  void writeFormattedArgument(Print& line, FormatCursor& cursor, const FormatSpec& spec, const First& first, const Rest&... rest) {
+    writeFormattedValue(line, spec, first);
+    writeFormatted(line, cursor, rest...);
   }
-};
+
+  static void writeFormatRange(Print& line, bool flash, const char* from, const char* to) {
+    if (to <= from) return;
+    const size_t length = static_cast<size_t>(to - from);
+    if (flash) {
+      writeFlash(line, from, length);
+    } else {
+      line.write(reinterpret_cast<const uint8_t*>(from), length);
+    }
+  }
+
+  // Writes the text up to the next conversion and parses it. false at the end of the format.
+  static bool nextFormatSpec(Print& line, FormatCursor& cursor, FormatSpec& spec) {
+    const char* text = cursor.p;
+    while (true) {
+      const char c = cursor.peek();
+      if (c == '\0') {
+        writeFormatRange(line, cursor.flash, text, cursor.p);
+        return false;
+      }
+      if (c != '%') {
+        cursor.p++;
+        continue;
+      }
+      writeFormatRange(line, cursor.flash, text, cursor.p);
+      spec = FormatSpec();
+      spec.start = cursor.p++;
+      if (cursor.peek() == '%') {
+        text = cursor.p++; // The second '%' is written with the next text
+        continue;
+      }
+      for (;; cursor.p++) {
+        const char flag = cursor.peek();
+        if (flag == '-') spec.left = true;
+        else if (flag == '0') spec.zero = true;
+        else if (flag == '+') spec.plus = true;
+        else if (flag == ' ') spec.space = true;
+        else if (flag == '#') spec.alternate = true;
+        else break;
+      }
+      spec.width = parseFormatNumber(cursor);
+      if (cursor.peek() == '.') {
+        cursor.p++;
+        spec.precision = static_cast<int8_t>(parseFormatNumber(cursor));
+      }
+      while (isFormatModifier(cursor.peek())) cursor.p++;
+      spec.conversion = cursor.peek();
+      if (spec.conversion == '\0') {
+        writeFormatRange(line, cursor.flash, spec.start, cursor.p);
+        return false;
+      }
+      cursor.p++;
+      return true;
+    }
+  }
+
+  static bool isFormatModifier(char c) { return c == 'h' || c == 'l' || c == 'z' || c == 'j' || c == 't' || c == 'L'; }
+
+  // Clamped to maxFormatWidth after every digit, so the next multiply never overflows.
+  static uint8_t parseFormatNumber(FormatCursor& cursor) {
+    uint16_t value = 0;
+    while (o3FormatDigit(cursor.peek())) {
+      value = static_cast<uint16_t>(value * 10 + (cursor.peek() - '0'));
+      if (value > maxFormatWidth) value = maxFormatWidth;
+      cursor.p++;
+    }
+    return static_cast<uint8_t>(value);
+  }
+
+  template <typename T>
+  void writeFormattedValue(Print& line, const FormatSpec& spec, const T& value) {
+    constexpr char kind = O3FormatKind<T>::value;
+    if constexpr (O3IsLazyPart<T>::value) {
+      writeFormattedValue(line, spec, value());
+    } else if constexpr (kind == 'i' || kind == 'c') {
+      writeFormattedInteger(line, spec, value);
+    } else if constexpr (kind == 'f') {
+      writeFormattedFloat(line, spec, value, spec.precision >= 0 ? static_cast<uint8_t>(spec.precision) : 6);
+    } else if constexpr (kind == 's') {
+      writeFormattedString(line, spec, value);
+    } else {
+      writePart(line, value);
+    }
+  }
+
+  template <typename T>
+  void writeFormattedValue(Print& line, const FormatSpec& spec, const O3Fixed<T>& part) {
+    writeFormattedFloat(line, spec, part.value, spec.precision >= 0 ? static_cast<uint8_t>(spec.precision) : part.decimals);
+  }
+
+  // Sign or "0x", zeros, digits, with the padding the flags ask for. minDigits is the precision
+  // of an integer (zeros in front, and the 0 flag no longer applies).
+  static void writeFormattedText(Print& line, const FormatSpec& spec, const char* prefix, size_t prefixLength,
+                                 const char* text, size_t length, bool numeric, int minDigits = -1) {
+    size_t zeros = minDigits > static_cast<int>(length) ? static_cast<size_t>(minDigits) - length : 0;
+    size_t total = prefixLength + zeros + length;
+    if (numeric && spec.zero && !spec.left && minDigits < 0 && spec.width > total) {
+      zeros += spec.width - total;
+      total = spec.width;
+    }
+    const size_t padding = spec.width > total ? spec.width - total : 0;
+    if (!spec.left) writeFill(line, ' ', padding);
+    if (prefixLength > 0) line.write(reinterpret_cast<const uint8_t*>(prefix), prefixLength);
+    writeFill(line, '0', zeros);
+    line.write(reinterpret_cast<const uint8_t*>(text), length);
+    if (spec.left) writeFill(line, ' ', padding);
+  }
+
+  // %d of a negative value prints the magnitude after a '-'. %u/%x/%o print the two's complement
+  // bits of the argument's own size, so %x of an int16_t -1 prints ffff.
+  template <typename T>
+  static void writeFormattedInteger(Print& line, const FormatSpec& spec, T value) {
+    const char conversion = spec.conversion;
+    if (conversion == 'c') {
+      const char c = static_cast<char>(value);
+      writeFormattedText(line, spec, nullptr, 0, &c, 1, false);
+      return;
+    }
+    using U = typename O3FormatBits<(sizeof(T) > 4)>::type;
+    bool negative = false;
+    if constexpr (static_cast<T>(-1) < static_cast<T>(0)) {
+      negative = value < 0 && conversion != 'u' && conversion != 'x' && conversion != 'X' && conversion != 'o';
+    }
+    U bits = static_cast<U>(value);
+    if (negative) {
+      bits = static_cast<U>(0u - bits); // In unsigned arithmetic, so the minimum value works too
+    } else if constexpr (sizeof(T) < sizeof(U)) {
+      bits &= (static_cast<U>(1) << (sizeof(T) * 8)) - 1;
+    }
+    writeFormattedNumber<U>(line, spec, bits, negative);
+  }
+
+  // bits is the magnitude, negative adds the '-'.
+  template <typename U>
+  static void writeFormattedNumber(Print& line, const FormatSpec& spec, U bits, bool negative) {
+    char prefix[2];
+    size_t prefixLength = 0;
+    char digits[O3Format::maxUnsigned64Digits + 3]; // 64 bits in octal take 22 digits
+    size_t length;
+    const char conversion = spec.conversion;
+    if (conversion == 'x' || conversion == 'X' || conversion == 'o') {
+      const uint8_t shift = conversion == 'o' ? 3 : 4;
+      const U mask = conversion == 'o' ? 7 : 15;
+      char* end = digits + sizeof(digits);
+      char* p = end;
+      do {
+        const char digit = O3Format::hexDigit(static_cast<uint8_t>(bits & mask));
+        *--p = conversion == 'X' && digit >= 'a' ? static_cast<char>(digit - 'a' + 'A') : digit;
+        bits >>= shift;
+      } while (bits != 0);
+      length = static_cast<size_t>(end - p);
+      memmove(digits, p, length);
+      // Like printf, a zero value stays a plain "0" even with '#'.
+      if (spec.alternate && !(length == 1 && digits[0] == '0')) {
+        prefix[prefixLength++] = '0';
+        if (conversion != 'o') prefix[prefixLength++] = conversion;
+      }
+    } else {
+      const bool signedConversion = conversion != 'u';
+      if (negative) {
+        prefix[prefixLength++] = '-';
+      } else if (signedConversion && spec.plus) {
+        prefix[prefixLength++] = '+';
+      } else if (signedConversion && spec.space) {
+        prefix[prefixLength++] = ' ';
+      }
+      if constexpr (sizeof(U) > 4) {
+        length = O3Format::formatUnsigned64(digits, bits);
+      } else {
+        length = O3Format::formatUnsigned(digits, bits);
+      }
+    }
+    writeFormattedText(line, spec, prefix, prefixLength, digits, length, true, spec.precision);
+  }
+
+  template <typename T>
+  static void writeFormattedFloat(Print& line, const FormatSpec& spec, T value, uint8_t decimals) {
+    char text[O3Format::maxFixedChars];
+    size_t length = O3Format::formatFixed(text, value, decimals);
+    const bool negative = text[0] == '-';
+    const char sign = negative ? '-' : spec.plus ? '+' : spec.space ? ' ' : '\0';
+    const bool number = text[negative ? 1 : 0] >= '0' && text[negative ? 1 : 0] <= '9';
+    writeFormattedText(line, spec, &sign, sign != '\0' ? 1 : 0, text + (negative ? 1 : 0), length - (negative ? 1 : 0), number);
+  }
+
+  // %s with precision prints at most that many characters.
+  static void writeFormattedString(Print& line, const FormatSpec& spec, const char* value) {
+    if (!value) value = "";
+    size_t length = 0;
+    const size_t limit = spec.precision >= 0 ? static_cast<size_t>(spec.precision) : static_cast<size_t>(-1);
+    while (length < limit && value[length] != '\0') length++;
+    writeFormattedText(line, spec, nullptr, 0, value, length, false);
+  }
+
+  static void writeFormattedString(Print& line, const FormatSpec& spec, const String& value) {
+    size_t length = value.length();
+    if (spec.precision >= 0 && static_cast<size_t>(spec.precision) < length) length = spec.precision;
+    writeFormattedText(line, spec, nullptr, 0, value.c_str(), length, false);
+  }
+
+  static void writeFormattedString(Print& line, const FormatSpec& spec, const O3Span& value) {
+    size_t length = value.data ? value.length : 0;
+    if (spec.precision >= 0 && static_cast<size_t>(spec.precision) < length) length = spec.precision;
+    writeFormattedText(line, spec, nullptr, 0, value.data, length, false);
+  }
+
+  static void writeFormattedString(Print& line, const FormatSpec& spec, const __FlashStringHelper* value) {
+    const char* text = reinterpret_cast<const char*>(value);
+    size_t length = text ? strlen_P(text) : 0;
+    if (spec.precision >= 0 && static_cast<size_t>(spec.precision) < length) length = spec.precision;
+    const size_t padding = spec.width > length ? spec.width - length : 0;
+    if (!spec.left) writeFill(line, ' ', padding);
+    writeFlash(line, text, length);
+    if (spec.left) writeFill(line, ' ', padding);
+  }
+
+  // Recursive variadic printer:
+  // - prints the first part
+  // - if there are remaining parts, prints separator then prints the rest
+  //
+  // if constexpr is a compile-time if. It only compiles the branch that is needed.
+  template <typename First, typename... Rest>
+  void writeParts(Print& line, const First& first, const Rest&... rest) {
+    writePart(line, first);
+    if constexpr (sizeof...(rest) > 0) {
+      line.print(partSeparatorBuffer);
+      writeParts(line, rest...);
+    }
+  }
+
+  // Variadic log: prints all parts in one line. callsiteId only ends up in binary records.
+  template <typename First, typename... Rest>
+  void parts(O3LogLevel level, uint8_t tag, uint16_t callsiteId, const First& first, const Rest&... rest) {
+    if (!canWrite(level) || !tagAccepts(tag, level) || !admitLine(level, tag, callsiteId, first, rest...)) return;
+    writeLine(level, tag, callsiteId, first, rest...);
+  }
+
+#if O3_LOG_PERSIST_BUFFER_SIZE > 0
+  // Result of a kv() part whose lazy value was called. It holds the value, the O3KeyValue that
+  // keepCalled() makes from it points at this copy.
+  template <typename Key, typename Value>
+  struct CalledKeyValue {
+    Key key;
+    Value value;
+  };
+
+  // Calls a lazy part and gives its result, other parts are passed on as they are.
+  template <typename T>
+  static decltype(auto) callLazy(const T& part) {
+    if constexpr (O3IsLazyPart<T>::value) {
+      return part();
+    } else {
+      return (part);
+    }
+  }
+
+  template <typename Key, typename Value>
+  static decltype(auto) callLazy(const O3KeyValue<Key, Value>& part) {
+    if constexpr (O3IsLazyPart<Value>::value) {
+      auto value = part.value();
+      return CalledKeyValue<Key, decltype(value)>{ part.key, value };
+    } else {
+      return (part);
+    }
+  }
+
+  template <typename T>
+  static const T& keepCalled(const T& part) {
+    return part;
+  }
+
+  template <typename Key, typename Value>
+  static O3KeyValue<Key, Value> keepCalled(const CalledKeyValue<Key, Value>& part) {
+    return { part.key, part.value };
+  }
+
+  // The results of callLazy() live until this call returns, so the parts can refer to them.
+  template <typename... Parts>
+  void writeCalledLine(O3LogLevel level, uint8_t tag, uint16_t callsiteId, const Parts&... parts) {
+    writeLine(level, tag, callsiteId, keepCalled(parts)...);
+  }
+#endif
+
+  // Writes one complete line in the configured format, after all filters passed.
+  template <typename First, typename... Rest>
+  void writeLine(O3LogLevel level, uint8_t tag, uint16_t callsiteId, const First& first, const Rest&... rest) {
+#if O3_LOG_PERSIST_BUFFER_SIZE > 0
+    // The crash log record and the outputs both read the parts, lazy parts are called once up front.
+    if constexpr (O3HasLazyValue<First>::value || (false || ... || O3HasLazyValue<Rest>::value)) {
+      writeCalledLine(level, tag, callsiteId, callLazy(first), callLazy(rest)...);
+      return;
+    }
+    // Stored before the outputs are written, so the line is kept even if writing it hangs.
+    persistLine(level, tag, first, rest...);
+    if (!sinkAccepts(outputLevel, level)) return;
+#endif
+#if O3_LOG_BACKLOG_BUFFER_SIZE > 0
+    if (holdLine(level, tag, first, rest...)) return;
+#endif
+    LineWriter line(*this, level);
+    line.tag = tag;
+#if O3_LOG_BINARY_FORMAT
+    if (format == O3LogFormat::Binary) {
+      writeRecord(line, level, callsiteId, first, rest...);
+      return;
+    }
+#else
+    (void)callsiteId;
+#endif
+#if O3_LOG_STRUCTURED_FORMAT
+    if (format == O3LogFormat::Json || format == O3LogFormat::Logfmt) {
+      writeStructured(line, level, first, rest...);
+      return;
+    }
+#endif
+    beginLine(line, level);
+    writeParts(line, first, rest...);
+    finishLine(line);
+  }
+
+  // ---------------------------------------------------------------------------
+  // Rate limiting and repeat suppression (O3_LOG_RATE_LIMIT)
+  //
+  // Decided from the raw argument values before anything is formatted.
+  // ---------------------------------------------------------------------------
+
+  void configureThrottle(const O3SerialWriterOptions& options) {
+#if O3_LOG_RATE_LIMIT
+    rateLimitPerSecond = options.rateLimitPerSecond;
+    rateLimitBurst = options.rateLimitBurst > 0 ? options.rateLimitBurst : 1;
+    suppressRepeats = options.suppressRepeats;
+    refillBuckets();
+#else
+    (void)options;
+#endif
+  }
+
+#if O3_LOG_RATE_LIMIT
+  void refillBuckets() {
+    const uint32_t now = millis();
+    for (size_t i = 0; i < throttleLevels; i++) {
+      bucketTokens[i] = static_cast<uint32_t>(rateLimitBurst) * 1000;
+      bucketRefilled[i] = now;
+    }
+  }
+#endif
+
+  // Returns false if the line must not be written. Prints the pending
+  // "last message repeated" / "rate limited" notes before a line that gets through.
+  template <typename... Parts>
+  bool admitLine(O3LogLevel level, uint8_t tag, uint16_t callsiteId, const Parts&... values) {
+#if O3_LOG_RATE_LIMIT
+    if (rateLimitPerSecond == 0 && !suppressRepeats) return true;
+    uint32_t hash = 2166136261u;
+    const uint8_t key[4] = { static_cast<uint8_t>(level), tag, static_cast<uint8_t>(callsiteId), static_cast<uint8_t>(callsiteId >> 8) };
+    hashBytes(hash, key, sizeof(key));
+    const bool hashable = suppressRepeats && hashParts(hash, values...);
+    uint32_t repeats = 0;
+    uint32_t limited = 0;
+    O3LogLevel repeatedLevel = level;
+    uint8_t repeatedTag = tag;
+    bool admitted;
+    {
+#if O3_LOG_THREAD_SAFE
+      LockGuard guard(mutex);
+#endif
+      const uint32_t now = millis();
+      if (hashable && repeatHashValid && hash == repeatHash) {
+        repeatCount++;
+        suppressedLineCount++;
+        if (now - repeatSince < repeatReportInterval) return false;
+        // Long run of repeats: report it now instead of when the run ends.
+        repeats = repeatCount;
+        repeatedLevel = repeatLevel;
+        repeatedTag = repeatTag;
+        repeatCount = 0;
+        repeatSince = now;
+        admitted = false;
+      } else if (!takeToken(level, now)) {
+        rateLimitedCount++;
+        suppressedLineCount++;
+        return false;
+      } else {
+        // The run that ends here belongs to the previous line, copied while other tasks wait.
+        repeats = repeatCount;
+        repeatedLevel = repeatLevel;
+        repeatedTag = repeatTag;
+        limited = rateLimitedCount;
+        repeatCount = 0;
+        rateLimitedCount = 0;
+        repeatHash = hash;
+        repeatHashValid = hashable;
+        repeatLevel = level;
+        repeatTag = tag;
+        repeatSince = now;
+        admitted = true;
+      }
+    }
+    if (repeats > 0) writeThrottleNote(repeatedLevel, repeatedTag, F("last message repeated "), repeats, F(" times"));
+    if (limited > 0) writeThrottleNote(level, tag, F(""), limited, F(" lines suppressed by rate limit"));
+    return admitted;
+#else
+    (void)level;
+    (void)tag;
+    (void)callsiteId;
+    ((void)values, ...);
+    return true;
+#endif
+  }
+
+#if O3_LOG_RATE_LIMIT
+  bool takeToken(O3LogLevel level, uint32_t now) {
+    if (rateLimitPerSecond == 0) return true;
+    const size_t index = static_cast<uint8_t>(level) % throttleLevels;
+    const uint32_t capacity = static_cast<uint32_t>(rateLimitBurst) * 1000;
+    const uint32_t elapsed = now - bucketRefilled[index];
+    bucketRefilled[index] = now;
+    // elapsed * rate only when it cannot overflow, anything longer refills the bucket completely.
+    if (elapsed > capacity / rateLimitPerSecond) {
+      bucketTokens[index] = capacity;
+    } else {
+      bucketTokens[index] += elapsed * rateLimitPerSecond;
+      if (bucketTokens[index] > capacity) bucketTokens[index] = capacity;
+    }
+    if (bucketTokens[index] < 1000) return false;
+    bucketTokens[index] -= 1000;
+    return true;
+  }
+
+  // The note is assembled into one text part and goes through writeLine(), so it comes out in the
+  // configured format: a text line, a JSON object, a logfmt line or a binary record.
+  void writeThrottleNote(O3LogLevel level, uint8_t tag, const __FlashStringHelper* before, uint32_t count, const __FlashStringHelper* after) {
+    char text[throttleNoteMaxLen];
+    size_t length = copyFlashText(text, sizeof(text), before);
+    length += O3Format::formatUnsigned(text + length, count);
+    length += copyFlashText(text + length, sizeof(text) - length, after);
+    writeLine(level, tag, 0, O3Span{ text, length });
+  }
+
+  // Copies a flash string without its NUL, returns the number of bytes copied.
+  static size_t copyFlashText(char* target, size_t capacity, const __FlashStringHelper* value) {
+    const char* source = reinterpret_cast<const char*>(value);
+    size_t length = source ? strlen_P(source) : 0;
+    if (length > capacity) length = capacity;
+    memcpy_P(target, source, length);
+    return length;
+  }
+
+  // Feeds the raw bytes of each part into the FNV-1a hash. Returns false for types that can only
+  // be compared by printing them (Printable and friends), those lines are never collapsed.
+  static void hashBytes(uint32_t& hash, const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) hash = (hash ^ bytes[i]) * 16777619u;
+  }
+
+  static bool hashPart(uint32_t& hash, const char* value) {
+    if (value) hashBytes(hash, value, strlen(value) + 1);
+    return true;
+  }
+  static bool hashPart(uint32_t& hash, const __FlashStringHelper* value) {
+    const char* text = reinterpret_cast<const char*>(value);
+    if (!text) return true;
+    for (;; text++) {
+      const uint8_t c = pgm_read_byte(text);
+      hash = (hash ^ c) * 16777619u;
+      if (c == 0) return true;
+    }
+  }
+  // Length-known text hashes like a C string, NUL included, so "ab", "c" and "a", "bc" differ.
+  static bool hashPart(uint32_t& hash, const O3Span& value) {
+    const uint8_t end = 0;
+    if (value.data) hashBytes(hash, value.data, value.length);
+    hashBytes(hash, &end, 1);
+    return true;
+  }
+  static bool hashPart(uint32_t& hash, const String& value) { hashBytes(hash, value.c_str(), value.length() + 1); return true; }
+  static bool hashPart(uint32_t& hash, char value)               { hashBytes(hash, &value, sizeof(value)); return true; }
+  static bool hashPart(uint32_t& hash, bool value)               { hashBytes(hash, &value, sizeof(value)); return true; }
+  static bool hashPart(uint32_t& hash, unsigned char value)      { hashBytes(hash, &value, sizeof(value)); return true; }
+  static bool hashPart(uint32_t& hash, short value)              { hashBytes(hash, &value, sizeof(value)); return true; }
+  static bool hashPart(uint32_t& hash, unsigned short value)     { hashBytes(hash, &value, sizeof(value)); return true; }
+  static bool hashPart(uint32_t& hash, int value)                { hashBytes(hash, &value, sizeof(value)); return true; }
+  static bool hashPart(uint32_t& hash, unsigned int value)       { hashBytes(hash, &value, sizeof(value)); return true; }
+  static bool hashPart(uint32_t& hash, long value)               { hashBytes(hash, &value, sizeof(value)); return true; }
+  static bool hashPart(uint32_t& hash, unsigned long value)      { hashBytes(hash, &value, sizeof(value)); return true; }
+  static bool hashPart(uint32_t& hash, long long value)          { hashBytes(hash, &value, sizeof(value)); return true; }
+  static bool hashPart(uint32_t& hash, unsigned long long value) { hashBytes(hash, &value, sizeof(value)); return true; }
+  static bool hashPart(uint32_t& hash, float value)              { hashBytes(hash, &value, sizeof(value)); return true; }
+  static bool hashPart(uint32_t& hash, double value)             { hashBytes(hash, &value, sizeof(value)); return true; }
+
+  template <typename T>
+  static bool hashPart(uint32_t& hash, const O3Fixed<T>& part) {
+    hashBytes(hash, &part.decimals, 1);
+    return hashPart(hash, part.value);
+  }
+
+  template <typename Key, typename Value>
+  static bool hashPart(uint32_t& hash, const O3KeyValue<Key, Value>& part) {
+    return hashPart(hash, part.key) && hashPart(hash, part.value);
+  }
+
+  // Lazy parts are not called here, so lines with them are never collapsed either.
+  template <typename T>
+  static bool hashPart(uint32_t&, const T&) {
+    return false;
+  }
+
+  template <typename First, typename... Rest>
+  static bool hashParts(uint32_t& hash, const First& first, const Rest&... rest) {
+    if (!hashPart(hash, first)) return false;
+    if constexpr (sizeof...(rest) > 0) {
+      return hashParts(hash, rest...);
+    } else {
+      return true;
+    }
+  }
+#endif
+
+#if O3_LOG_STRUCTURED_FORMAT
+  // ---------------------------------------------------------------------------
+  // Json / Logfmt records
+  //
+  // Written in one pass straight into the LineWriter: the message parts are joined into "msg",
+  // then every kv() part becomes a field of its own.
+  // ---------------------------------------------------------------------------
+
+  // Escapes string content on the way through, runs of plain characters are forwarded in one write.
+  // The JSON escapes (\" \\ \n \r \t \u00XX) are valid inside quoted logfmt values as well.
+  class EscapeWriter : public Print {
+  public:
+    explicit EscapeWriter(Print& output) : target(output) {}
+
+    using Print::write;
+
+    size_t write(uint8_t value) override { return write(&value, 1); }
+
+    size_t write(const uint8_t* data, size_t size) override {
+      size_t start = 0;
+      for (size_t i = 0; i < size; i++) {
+        const uint8_t c = data[i];
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        if (i > start) target.write(data + start, i - start);
+        start = i + 1;
+        writeEscape(c);
+      }
+      if (size > start) target.write(data + start, size - start);
+      return size;
+    }
+
+  private:
+    void writeEscape(uint8_t c) {
+      uint8_t text[6] = { '\\', c, '0', '0', '0', '0' };
+      size_t length = 2;
+      switch (c) {
+        case '\n': text[1] = 'n'; break;
+        case '\r': text[1] = 'r'; break;
+        case '\t': text[1] = 't'; break;
+        case '"':
+        case '\\': break;
+        default:
+          text[1] = 'u';
+          O3Format::formatHexByte(reinterpret_cast<char*>(text) + 4, c);
+          length = 6;
+          break;
+      }
+      target.write(text, length);
+    }
+
+    Print& target;
+  };
+
+  template <typename... Parts>
+  void writeStructured(LineWriter& line, O3LogLevel level, const Parts&... values) {
+    // A half-built text line from the print() chain is finished first.
+    if (!O3_LOG_THREAD_SAFE && lineOpen) endLine(line);
+    line.level = level;
+    const bool json = format == O3LogFormat::Json;
+    bool first = true;
+    if (json) line.write('{');
+
+    if (showMillis) {
+      writeFieldName(line, first, F("ts"));
+      char text[maxTimestampChars];
+      line.write(reinterpret_cast<const uint8_t*>(text), formatTimestamp(*this, text));
+    }
+    if (showLevel) {
+      writeFieldName(line, first, F("level"));
+      if (json) line.write('"');
+      writeFlash(line, levelText(level));
+      if (json) line.write('"');
+    }
+    if (line.tag > 0) {
+      char name[prefixMaxLen];
+      writeFieldName(line, first, F("prefix"));
+      writeFieldValue(line, static_cast<const char*>(name), tagName(line.tag, name));
+    } else if (prefixLength > 0) {
+      writeFieldName(line, first, F("prefix"));
+      writeFieldValue(line, static_cast<const char*>(prefixBuffer + 1), prefixLength);
+    }
+
+    constexpr size_t messageParts = (0 + ... + (O3IsKeyValue<Parts>::value ? 0 : 1));
+    if constexpr (messageParts > 0) {
+      writeFieldName(line, first, F("msg"));
+      line.write('"');
+      EscapeWriter escaped(line);
+      bool any = false;
+      writeMessageParts(escaped, any, values...);
+      line.write('"');
+    }
+    writeKeyValueFields(line, first, values...);
+
+    if (json) line.write('}');
+    line.println();
+    line.commit();
+    finishRecord();
+  }
+
+  template <typename Key>
+  void writeFieldName(Print& line, bool& first, Key name) {
+    const bool json = format == O3LogFormat::Json;
+    if (!first) line.write(json ? ',' : ' ');
+    first = false;
+    if (json) {
+      line.write('"');
+      EscapeWriter escaped(line);
+      writePart(escaped, name);
+      line.write('"');
+      line.write(':');
+    } else {
+      writePart(line, name);
+      line.write('=');
+    }
+  }
+
+  template <typename First, typename... Rest>
+  void writeMessageParts(Print& line, bool& any, const First& first, const Rest&... rest) {
+    if constexpr (!O3IsKeyValue<First>::value) {
+      if (any) line.print(partSeparatorBuffer);
+      writePart(line, first);
+      any = true;
+    }
+    if constexpr (sizeof...(rest) > 0) {
+      writeMessageParts(line, any, rest...);
+    }
+  }
+
+  template <typename First, typename... Rest>
+  void writeKeyValueFields(Print& line, bool& first, const First& part, const Rest&... rest) {
+    if constexpr (O3IsKeyValue<First>::value) {
+      writeFieldName(line, first, part.key);
+      writeFieldValue(line, part.value);
+    }
+    if constexpr (sizeof...(rest) > 0) {
+      writeKeyValueFields(line, first, rest...);
+    }
+  }
+
+  // Numbers and bools are written bare. Strings are quoted, in logfmt only when they need it.
+  // Anything else (Printable, ...) is printed as a quoted string.
+  template <typename T>
+  void writeFieldValue(Print& line, const T& value) {
+    if constexpr (O3IsLazyPart<T>::value) {
+      writeFieldValue(line, value());
+    } else {
+      line.write('"');
+      EscapeWriter escaped(line);
+      writePart(escaped, value);
+      line.write('"');
+    }
+  }
+
+  void writeFieldValue(Print& line, const char* value) {
+    if (!value) value = "";
+    writeFieldValue(line, value, strlen(value));
+  }
+
+  void writeFieldValue(Print& line, const char* value, size_t length) {
+    const bool quoted = format == O3LogFormat::Json || logfmtNeedsQuotes(value, length);
+    if (quoted) line.write('"');
+    EscapeWriter escaped(line);
+    escaped.write(reinterpret_cast<const uint8_t*>(value), length);
+    if (quoted) line.write('"');
+  }
+
+  void writeFieldValue(Print& line, const __FlashStringHelper* value) {
+    const char* text = reinterpret_cast<const char*>(value);
+    bool quoted = format == O3LogFormat::Json || !text || pgm_read_byte(text) == 0;
+    for (const char* p = text; !quoted && p && pgm_read_byte(p) != 0; p++) {
+      const char c = static_cast<char>(pgm_read_byte(p));
+      quoted = logfmtNeedsQuotes(&c, 1);
+    }
+    if (quoted) line.write('"');
+    EscapeWriter escaped(line);
+    writeFlash(escaped, value);
+    if (quoted) line.write('"');
+  }
+
+  void writeFieldValue(Print& line, const String& value) { writeFieldValue(line, value.c_str(), value.length()); }
+  void writeFieldValue(Print& line, const O3Span& value) { writeFieldValue(line, value.data ? value.data : "", value.data ? value.length : 0); }
+  void writeFieldValue(Print& line, char value)          { writeFieldValue(line, &value, 1); }
+  void writeFieldValue(Print& line, bool value)          { writeFlash(line, value ? F("true") : F("false")); }
+
+  void writeFieldValue(Print& line, unsigned char value)      { writePart(line, value); }
+  void writeFieldValue(Print& line, short value)              { writePart(line, value); }
+  void writeFieldValue(Print& line, unsigned short value)     { writePart(line, value); }
+  void writeFieldValue(Print& line, int value)                { writePart(line, value); }
+  void writeFieldValue(Print& line, unsigned int value)       { writePart(line, value); }
+  void writeFieldValue(Print& line, long value)               { writePart(line, value); }
+  void writeFieldValue(Print& line, unsigned long value)      { writePart(line, value); }
+  void writeFieldValue(Print& line, long long value)          { writePart(line, value); }
+  void writeFieldValue(Print& line, unsigned long long value) { writePart(line, value); }
+
+  // JSON has no nan/inf, and the formatter writes "ovf" for values it cannot print: those become null.
+  template <typename T>
+  void writeFixedField(Print& line, T value, uint8_t decimals) {
+    if (format == O3LogFormat::Json && (isnan(value) || isinf(value) || value > static_cast<T>(4294967040.0) || value < static_cast<T>(-4294967040.0))) {
+      writeFlash(line, F("null"));
+      return;
+    }
+    writeFixedText(line, value, decimals);
+  }
+
+  void writeFieldValue(Print& line, float value)  { writeFixedField(line, value, 2); }
+  void writeFieldValue(Print& line, double value) { writeFixedField(line, value, 2); }
+
+  template <typename T>
+  void writeFieldValue(Print& line, const O3Fixed<T>& part) { writeFixedField(line, part.value, part.decimals); }
+
+  static bool logfmtNeedsQuotes(const char* value, size_t length) {
+    if (length == 0) return true;
+    for (size_t i = 0; i < length; i++) {
+      const char c = value[i];
+      if (static_cast<uint8_t>(c) <= ' ' || c == '=' || c == '"' || c == '\\') return true;
+    }
+    return false;
+  }
+#endif
+
+#if O3_LOG_BINARY_FORMAT || O3_LOG_PERSIST_BUFFER_SIZE > 0 || O3_LOG_BACKLOG_BUFFER_SIZE > 0
+  // ---------------------------------------------------------------------------
+  // Binary records (see the format description at the top of this file),
+  // the crash log and the backlog store their parts in the same encoding
+  // ---------------------------------------------------------------------------
+
+  template <typename T>
+  static void writeVarint(Print& line, T value) {
+    uint8_t bytes[(sizeof(T) * 8 + 6) / 7];
+    size_t count = 0;
+    do {
+      uint8_t byte = static_cast<uint8_t>(value & 0x7F);
+      value >>= 7;
+      if (value != 0) byte |= 0x80;
+      bytes[count++] = byte;
+    } while (value != 0);
+    line.write(bytes, count);
+  }
+
+  static void writeTagged(Print& line, uint8_t tag, const void* data, size_t size) {
+    line.write(tag);
+    line.write(static_cast<const uint8_t*>(data), size);
+  }
+
+  // Integers are sent as varints, small values (the common case) take one or two bytes.
+  static void writeSigned(Print& line, long value) {
+    line.write(static_cast<uint8_t>(0x02));
+    writeVarint(line, (static_cast<unsigned long>(value) << 1) ^ static_cast<unsigned long>(value >> (sizeof(long) * 8 - 1)));
+  }
+
+  static void writeUnsigned(Print& line, unsigned long value) {
+    line.write(static_cast<uint8_t>(0x03));
+    writeVarint(line, value);
+  }
+
+  void writeBinaryPart(Print& line, const char* value) {
+    line.write(static_cast<uint8_t>(0x01));
+    if (value) line.print(value);
+    line.write(static_cast<uint8_t>(0));
+  }
+  void writeBinaryPart(Print& line, char value)           { writeTagged(line, 0x06, &value, 1); }
+  void writeBinaryPart(Print& line, bool value)           { const uint8_t byte = value ? 1 : 0; writeTagged(line, 0x07, &byte, 1); }
+  void writeBinaryPart(Print& line, unsigned char value)  { writeUnsigned(line, value); }
+  void writeBinaryPart(Print& line, short value)          { writeSigned(line, value); }
+  void writeBinaryPart(Print& line, unsigned short value) { writeUnsigned(line, value); }
+  void writeBinaryPart(Print& line, int value)            { writeSigned(line, value); }
+  void writeBinaryPart(Print& line, unsigned int value)   { writeUnsigned(line, value); }
+  void writeBinaryPart(Print& line, long value)           { writeSigned(line, value); }
+  void writeBinaryPart(Print& line, unsigned long value)  { writeUnsigned(line, value); }
+  void writeBinaryPart(Print& line, long long value) {
+    line.write(static_cast<uint8_t>(0x02));
+    writeVarint(line, (static_cast<unsigned long long>(value) << 1) ^ static_cast<unsigned long long>(value >> 63));
+  }
+  void writeBinaryPart(Print& line, unsigned long long value) {
+    line.write(static_cast<uint8_t>(0x03));
+    writeVarint(line, value);
+  }
+  // Raw IEEE-754 bytes, all supported boards are little-endian. On AVR double is 4 bytes.
+  void writeBinaryPart(Print& line, float value)  { writeTagged(line, 0x04, &value, 4); }
+  void writeBinaryPart(Print& line, double value) { writeTagged(line, sizeof(double) == 4 ? 0x04 : 0x05, &value, sizeof(double)); }
+
+  // Text parts with a known length. A NUL inside the text ends the part early when it is decoded.
+  void writeBinaryPart(Print& line, const O3Span& value) { writeBinaryText(line, value.data, value.data ? value.length : 0); }
+  void writeBinaryPart(Print& line, const String& value) { writeBinaryText(line, value.c_str(), value.length()); }
+
+  static void writeBinaryText(Print& line, const char* text, size_t length) {
+    line.write(static_cast<uint8_t>(0x01));
+    line.write(reinterpret_cast<const uint8_t*>(text), length);
+    line.write(static_cast<uint8_t>(0));
+  }
+
+  void writeBinaryPart(Print& line, const __FlashStringHelper* value) {
+    line.write(static_cast<uint8_t>(0x01));
+    writeFlash(line, value);
+    line.write(static_cast<uint8_t>(0));
+  }
+
+  template <typename T>
+  void writeBinaryPart(Print& line, const O3Fixed<T>& part) {
+    const uint8_t header[2] = { 0x09, part.decimals };
+    line.write(header, sizeof(header));
+    writeBinaryPart(line, part.value);
+  }
+
+  template <typename Key, typename Value>
+  void writeBinaryPart(Print& line, const O3KeyValue<Key, Value>& part) {
+    line.write(static_cast<uint8_t>(0x08));
+    writePart(line, part.key);
+    line.write(static_cast<uint8_t>(0));
+    writeBinaryPart(line, part.value);
+  }
+
+  // Anything else (Printable, ...) is rendered with writePart() as a text part.
+  template <typename T>
+  void writeBinaryPart(Print& line, const T& value) {
+    if constexpr (O3IsLazyPart<T>::value) {
+      writeBinaryPart(line, value());
+    } else {
+      line.write(static_cast<uint8_t>(0x01));
+      writePart(line, value);
+      line.write(static_cast<uint8_t>(0));
+    }
+  }
+
+  template <typename First, typename... Rest>
+  void writeBinaryParts(Print& line, const First& first, const Rest&... rest) {
+    writeBinaryPart(line, first);
+    if constexpr (sizeof...(rest) > 0) {
+      writeBinaryParts(line, rest...);
+    }
+  }
+
+#if O3_LOG_BINARY_FORMAT
+  template <typename First, typename... Rest>
+  void writeRecord(LineWriter& line, O3LogLevel level, uint16_t callsiteId, const First& first, const Rest&... rest) {
+    // A half-built text line from the print() chain is finished first.
+    if (!O3_LOG_THREAD_SAFE && lineOpen) endLine(line);
+    const uint8_t start[2] = { O3RecordStart, static_cast<uint8_t>(level) };
+    line.write(start, sizeof(start));
+    writeVarint(line, readTimestamp(*this));
+    writeVarint(line, callsiteId);
+    writeBinaryParts(line, first, rest...);
+    line.write(static_cast<uint8_t>(0));
+    line.commit();
+    finishRecord();
+  }
+#endif
+#endif
+
+#if O3_LOG_PERSIST_BUFFER_SIZE > 0 || O3_LOG_BACKLOG_BUFFER_SIZE > 0
+  // ---------------------------------------------------------------------------
+  // Record rings, shared by the crash log and the pre-trigger backlog
+  //
+  // Ring layout: every record is [length][info][tag, only if info bit 7 is set][varint timestamp]
+  // [varint milliseconds, Epoch only][parts...], length counts the bytes after itself.
+  // info is level | O3TimestampSource << 4 | 0x80 for a tagged line.
+  // For Epoch the timestamp is the Unix second. A record with only info byte 0xFF marks a reset.
+  // position (head and tail) changes with a single store after the bytes are in place, so a reset
+  // in the middle of a log call loses at most that line.
+  // ---------------------------------------------------------------------------
+
+  static constexpr uint8_t persistResetMarker = 0xFF;
+  static constexpr uint8_t recordTagged = 0x80;
+
+  static size_t ringHead(uint32_t position) { return position & 0xFFFF; }
+  static size_t ringTail(uint32_t position) { return position >> 16; }
+
+  static void ringSetPosition(volatile uint32_t& position, size_t head, size_t tail) {
+    // Keeps the compiler from moving the record bytes behind the position update.
+    __asm__ __volatile__("" ::: "memory");
+    position = static_cast<uint32_t>(head) | (static_cast<uint32_t>(tail) << 16);
+  }
+
+  // Print adapter that appends one record to a ring of Size bytes, evicting the oldest records
+  // as it runs into them. Bytes beyond maxRecord are cut off, the replay copes with a cut part.
+  template <size_t Size>
+  class RecordWriter : public Print {
+  public:
+    static constexpr size_t maxRecord = Size - 2 < 255 ? Size - 2 : 255;
+
+    RecordWriter(uint8_t* ringBytes, volatile uint32_t& ringPosition)
+        : ring(ringBytes), position(ringPosition), start(ringHead(ringPosition)), index((start + 1) % Size) {}
+
+    using Print::write;
+
+    size_t write(uint8_t value) override {
+      if (length == maxRecord) return 0;
+      const size_t tail = ringTail(position);
+      if (index == tail && tail != start) ringSetPosition(position, start, (tail + 1 + ring[tail]) % Size);
+      ring[index] = value;
+      index = (index + 1) % Size;
+      length++;
+      return 1;
+    }
+
+    size_t write(const uint8_t* data, size_t size) override {
+      size_t written = 0;
+      while (written < size && write(data[written])) written++;
+      return written;
+    }
+
+    // Publishes the record.
+    void finish() {
+      ring[start] = static_cast<uint8_t>(length);
+      ringSetPosition(position, index, ringTail(position));
+    }
+
+  private:
+    uint8_t* ring;
+    volatile uint32_t& position;
+    size_t start;
+    size_t index;
+    size_t length = 0;
+  };
+
+  // Reads back one record, indices wrap around the ring of Size bytes.
+  template <size_t Size>
+  class RecordReader {
+  public:
+    RecordReader(const uint8_t* ringBytes, size_t first, size_t size) : ring(ringBytes), index(first), remaining(size) {}
+
+    bool byte(uint8_t& value) {
+      if (remaining == 0) return false;
+      value = ring[index];
+      index = (index + 1) % Size;
+      remaining--;
+      return true;
+    }
+
+    bool bytes(void* target, size_t size) {
+      uint8_t* p = static_cast<uint8_t*>(target);
+      for (size_t i = 0; i < size; i++) {
+        if (!byte(p[i])) return false;
+      }
+      return true;
+    }
+
+    bool varint(uint64_t& value) {
+      value = 0;
+      uint8_t byteValue;
+      for (uint8_t shift = 0; shift < 64; shift += 7) {
+        if (!byte(byteValue)) return false;
+        value |= static_cast<uint64_t>(byteValue & 0x7F) << shift;
+        if (!(byteValue & 0x80)) return true;
+      }
+      return false;
+    }
+
+    void skipRest() { remaining = 0; }
+
+  private:
+    const uint8_t* ring;
+    size_t index;
+    size_t remaining;
+  };
+
+  // Everything of a record before its parts.
+  void writeRecordStart(Print& record, O3LogLevel level, uint8_t tag) {
+    const uint8_t info = static_cast<uint8_t>(level) | (static_cast<uint8_t>(timestampSource) << 4) | (tag > 0 ? recordTagged : 0);
+    record.write(info);
+    if (tag > 0) record.write(tag);
+    writeRecordTimestamp(record);
+  }
+
+  // The value the header of this line shows (the delta sources are only read, not advanced).
+  void writeRecordTimestamp(Print& record) {
+    switch (timestampSource) {
+      case O3TimestampSource::Micros:      writeVarint(record, static_cast<uint32_t>(micros())); break;
+      case O3TimestampSource::DeltaMillis: writeVarint(record, static_cast<uint32_t>(millis() - previousTimestamp)); break;
+      case O3TimestampSource::DeltaMicros: writeVarint(record, static_cast<uint32_t>(micros() - previousTimestamp)); break;
+      case O3TimestampSource::Epoch: {
+        const uint32_t elapsed = readEpochMillis(*this);
+        writeVarint(record, epochSeconds + elapsed / 1000);
+        writeVarint(record, elapsed % 1000);
+        break;
+      }
+      default: writeVarint(record, static_cast<uint32_t>(millis())); break;
+    }
+  }
+
+  // Writes one stored record as a text line. Returns false for reset markers and broken records.
+  template <typename Reader>
+  bool replayRecord(Reader& record) {
+    uint8_t info;
+    if (!record.byte(info)) return false;
+    if (info == persistResetMarker) {
+      // Level None reaches every enabled output.
+      LineWriter line(*this, O3LogLevel::None);
+      if (!O3_LOG_THREAD_SAFE && lineOpen) endLine(line);
+      writeFlash(line, F("----- reset -----"));
+      line.println();
+      line.commit();
+      finishRecord();
+      return false;
+    }
+
+    const O3LogLevel level = static_cast<O3LogLevel>(info & 0x0F);
+    const uint8_t source = (info >> 4) & 0x07;
+    uint8_t tag = 0;
+    uint64_t stamp = 0;
+    uint64_t stampMillis = 0;
+    if ((info & recordTagged) && !record.byte(tag)) return false;
+    if (!record.varint(stamp)) return false;
+    if (source == static_cast<uint8_t>(O3TimestampSource::Epoch) && !record.varint(stampMillis)) return false;
+
+    LineWriter line(*this, level);
+    if (!O3_LOG_THREAD_SAFE && lineOpen) endLine(line);
+    line.tag = tag;
+    char tail[headerTailSize];
+    size_t length = 0;
+    if (showMillis) {
+      if (source == static_cast<uint8_t>(O3TimestampSource::Epoch)) {
+        length = formatEpochText(tail, static_cast<uint32_t>(stamp), static_cast<uint32_t>(stampMillis));
+      } else {
+        length = O3Format::formatUnsignedPadded(tail, static_cast<uint32_t>(stamp), millisWidth);
+      }
+      tail[length++] = ' ';
+    }
+    writeHeader(line, level, tail, length);
+
+    uint8_t partTag;
+    bool first = true;
+    while (record.byte(partTag)) {
+      if (!first) line.print(partSeparatorBuffer);
+      first = false;
+      replayPart(line, record, partTag);
+    }
+    line.println();
+    line.commit();
+    finishRecord();
+    return true;
+  }
+
+  // Text of one part, the counterpart of writeBinaryPart().
+  template <typename Reader>
+  void replayPart(Print& line, Reader& record, uint8_t tag) {
+    uint8_t decimals = 2;
+    if (tag == 0x08) {
+      replayText(line, record);
+      line.write('=');
+      if (!record.byte(tag)) return;
+    }
+    if (tag == 0x09 && (!record.byte(decimals) || !record.byte(tag))) return;
+
+    uint8_t raw[8];
+    uint64_t value;
+    switch (tag) {
+      case 0x01:
+        replayText(line, record);
+        break;
+      case 0x02:
+        if (record.varint(value)) writeSignedText(line, static_cast<int64_t>((value >> 1) ^ (0 - (value & 1))));
+        break;
+      case 0x03:
+        if (record.varint(value)) writeUnsignedText(line, value);
+        break;
+      case 0x04:
+        if (record.bytes(raw, 4)) {
+          float number;
+          memcpy(&number, raw, 4);
+          writeFixedText(line, number, decimals);
+        }
+        break;
+      case 0x05:
+        if (record.bytes(raw, 8) && sizeof(double) == 8) {
+          double number;
+          memcpy(&number, raw, sizeof(number));
+          writeFixedText(line, number, decimals);
+        }
+        break;
+      case 0x06:
+        if (record.byte(raw[0])) line.print(static_cast<char>(raw[0]));
+        break;
+      case 0x07:
+        if (record.byte(raw[0])) writePart(line, raw[0] != 0);
+        break;
+      default:
+        record.skipRest(); // Unknown tag, the rest cannot be read
+        break;
+    }
+  }
+
+  // NUL terminated text, written in small blocks.
+  template <typename Reader>
+  static void replayText(Print& line, Reader& record) {
+    uint8_t chunk[16];
+    size_t length = 0;
+    uint8_t value;
+    while (record.byte(value) && value != 0) {
+      chunk[length++] = value;
+      if (length == sizeof(chunk)) {
+        line.write(chunk, length);
+        length = 0;
+      }
+    }
+    if (length > 0) line.write(chunk, length);
+  }
+#endif
+
+#if O3_LOG_PERSIST_BUFFER_SIZE > 0
+  // ---------------------------------------------------------------------------
+  // Crash log: a record ring in an O3PersistentLog
+  // ---------------------------------------------------------------------------
+
+  static constexpr size_t persistBufferSize = O3_LOG_PERSIST_BUFFER_SIZE;
+  static_assert(persistBufferSize >= 32 && persistBufferSize <= 0xFFFF, "O3_LOG_PERSIST_BUFFER_SIZE must be 32..65535");
+  static constexpr uint32_t persistMagic = 0x4F33504Cul ^ persistBufferSize; // "O3PL", a new size starts a new log
+  using PersistWriter = RecordWriter<persistBufferSize>;
+  using PersistReader = RecordReader<persistBufferSize>;
+
+  static size_t persistIndex(size_t index) { return index % persistBufferSize; }
+  static size_t persistHead(const O3PersistentLog& log) { return ringHead(log.position); }
+  static size_t persistTail(const O3PersistentLog& log) { return ringTail(log.position); }
+
+  // The log is taken as is only if the header and the chain of record lengths are intact.
+  static bool persistValid(const O3PersistentLog& log) {
+    if (log.magic != persistMagic) return false;
+    const size_t head = persistHead(log);
+    size_t index = persistTail(log);
+    if (head >= persistBufferSize || index >= persistBufferSize) return false;
+    while (index != head) {
+      const size_t used = persistIndex(head + persistBufferSize - index);
+      const size_t step = 1 + static_cast<size_t>(log.bytes[index]);
+      if (step > used) return false;
+      index = persistIndex(index + step);
+    }
+    return true;
+  }
+
+  template <typename First, typename... Rest>
+  void persistLine(O3LogLevel level, uint8_t tag, const First& first, const Rest&... rest) {
+    if (!persistLog || !sinkAccepts(persistLevel, level)) return;
+#if O3_LOG_THREAD_SAFE
+    LockGuard guard(mutex);
+#endif
+    PersistWriter record(persistLog->bytes, persistLog->position);
+    writeRecordStart(record, level, tag);
+    writeBinaryParts(record, first, rest...);
+    record.finish();
+  }
+#endif
+
+#if O3_LOG_BACKLOG_BUFFER_SIZE > 0
+  // ---------------------------------------------------------------------------
+  // Pre-trigger backlog: a record ring in RAM, see setBacklogTrigger()
+  // ---------------------------------------------------------------------------
+
+  using BacklogWriter = RecordWriter<backlogBufferSize>;
+
+  // Returns true if the line was kept instead of written. A line at the trigger level
+  // writes the kept lines first and is then written as usual.
+  template <typename First, typename... Rest>
+  bool holdLine(O3LogLevel level, uint8_t tag, const First& first, const Rest&... rest) {
+#if O3_LOG_STRUCTURED_FORMAT
+    if (format == O3LogFormat::Json || format == O3LogFormat::Logfmt) return false;
+#endif
+    if (static_cast<uint8_t>(level) >= static_cast<uint8_t>(backlogLevel)) {
+      // No check for an empty ring here: the position is only read under the lock, in
+      // takeBacklogRecord(). On AVR the 32-bit load is not atomic and could see half an update.
+      dumpBacklog();
+      return false;
+    }
+#if O3_LOG_THREAD_SAFE
+    LockGuard guard(mutex);
+#endif
+    BacklogWriter record(backlogBytes, backlogPosition);
+    writeRecordStart(record, level, tag);
+    writeBinaryParts(record, first, rest...);
+    record.finish();
+    return true;
+  }
+
+  // Moves the oldest record out of the ring, so other tasks can keep logging during the replay.
+  bool takeBacklogRecord(uint8_t* target, size_t& length) {
+#if O3_LOG_THREAD_SAFE
+    LockGuard guard(mutex);
+#endif
+    const size_t head = ringHead(backlogPosition);
+    const size_t tail = ringTail(backlogPosition);
+    if (head == tail) return false;
+    length = backlogBytes[tail];
+    for (size_t i = 0; i < length; i++) target[i] = backlogBytes[(tail + 1 + i) % backlogBufferSize];
+    ringSetPosition(backlogPosition, head, (tail + 1 + length) % backlogBufferSize);
+    return true;
+  }
+#endif
+
+  // Tells the binary decoder how to render headers. Does nothing in text mode.
+  void writeSettingsRecord() {
+#if O3_LOG_BINARY_FORMAT
+    if (format != O3LogFormat::Binary || !enabled || !out) return;
+    // Level None reaches every enabled output.
+    LineWriter line(*this, O3LogLevel::None);
+    if (!O3_LOG_THREAD_SAFE && lineOpen) endLine(line);
+    line.write(O3SettingsStart);
+    line.write(reinterpret_cast<const uint8_t*>(prefixBuffer + 1), prefixLength);
+    line.write(static_cast<uint8_t>(0));
+    line.write(reinterpret_cast<const uint8_t*>(partSeparatorBuffer), strlen(partSeparatorBuffer) + 1);
+    line.write(static_cast<uint8_t>((showMillis ? 1 : 0) | (showLevel ? 2 : 0) | (static_cast<uint8_t>(timestampSource) << 2) |
+                                    (millisWidth > 0 ? 0x20 : 0)));
+    if (timestampSource == O3TimestampSource::Epoch) writeVarint(line, epochSeconds);
+    if (millisWidth > 0) line.write(static_cast<uint8_t>(millisWidth < O3Format::maxUnsignedDigits ? millisWidth : O3Format::maxUnsignedDigits));
+    line.commit();
+    finishRecord();
+#endif
+  }
+};
+
+// Logger for one module, see O3SerialWriter::tag(). Holds only the writer and the tag id,
+// so it is cheap to copy and to keep as a global or member per module.
+class O3LogTag {
+public:
+  O3LogTag() = default;
+
+  void debug(const __FlashStringHelper* message) { if constexpr (o3LogLevelCompiledIn(O3LogLevel::Debug)) line(O3LogLevel::Debug, message); }
+  void info(const __FlashStringHelper* message)  { if constexpr (o3LogLevelCompiledIn(O3LogLevel::Info))  line(O3LogLevel::Info,  message); }
+  void warn(const __FlashStringHelper* message)  { if constexpr (o3LogLevelCompiledIn(O3LogLevel::Warn))  line(O3LogLevel::Warn,  message); }
+  void error(const __FlashStringHelper* message) { if constexpr (o3LogLevelCompiledIn(O3LogLevel::Error)) line(O3LogLevel::Error, message); }
+
+  void debug(const char* message) { if constexpr (o3LogLevelCompiledIn(O3LogLevel::Debug)) line(O3LogLevel::Debug, message); }
+  void info(const char* message)  { if constexpr (o3LogLevelCompiledIn(O3LogLevel::Info))  line(O3LogLevel::Info,  message); }
+  void warn(const char* message)  { if constexpr (o3LogLevelCompiledIn(O3LogLevel::Warn))  line(O3LogLevel::Warn,  message); }
+  void error(const char* message) { if constexpr (o3LogLevelCompiledIn(O3LogLevel::Error)) line(O3LogLevel::Error, message); }
+
+  template <typename First, typename... Rest>
+  void debug(const First& first, const Rest&... rest) {
+    if constexpr (o3LogLevelCompiledIn(O3LogLevel::Debug)) logWithId(O3LogLevel::Debug, 0, first, rest...);
+  }
+
+  template <typename First, typename... Rest>
+  void info(const First& first, const Rest&... rest) {
+    if constexpr (o3LogLevelCompiledIn(O3LogLevel::Info)) logWithId(O3LogLevel::Info, 0, first, rest...);
+  }
+
+  template <typename First, typename... Rest>
+  void warn(const First& first, const Rest&... rest) {
+    if constexpr (o3LogLevelCompiledIn(O3LogLevel::Warn)) logWithId(O3LogLevel::Warn, 0, first, rest...);
+  }
+
+  template <typename First, typename... Rest>
+  void error(const First& first, const Rest&... rest) {
+    if constexpr (o3LogLevelCompiledIn(O3LogLevel::Error)) logWithId(O3LogLevel::Error, 0, first, rest...);
+  }
+
+  // printf-style lines, see O3SerialWriter::infof().
+  template <typename Format, typename... Args>
+  void debugf(const Format& text, const Args&... args) {
+    if constexpr (o3LogLevelCompiledIn(O3LogLevel::Debug)) formatLine(O3LogLevel::Debug, text, args...);
+  }
+
+  template <typename Format, typename... Args>
+  void infof(const Format& text, const Args&... args) {
+    if constexpr (o3LogLevelCompiledIn(O3LogLevel::Info)) formatLine(O3LogLevel::Info, text, args...);
+  }
+
+  template <typename Format, typename... Args>
+  void warnf(const Format& text, const Args&... args) {
+    if constexpr (o3LogLevelCompiledIn(O3LogLevel::Warn)) formatLine(O3LogLevel::Warn, text, args...);
+  }
+
+  template <typename Format, typename... Args>
+  void errorf(const Format& text, const Args&... args) {
+    if constexpr (o3LogLevelCompiledIn(O3LogLevel::Error)) formatLine(O3LogLevel::Error, text, args...);
+  }
+
+  // Also makes the O3_LOG_DEBUG(tag, ...) style macros work on a tag.
+  template <typename First, typename... Rest>
+  void logWithId(O3LogLevel level, uint16_t callsiteId, const First& first, const Rest&... rest) {
+    if (writer) writer->parts(level, id, callsiteId, first, rest...);
+  }
+
+  // Lines of this tag below level are dropped before any output sees them (default Debug).
+  void setMinLevel(O3LogLevel level) {
+    if (writer && id > 0) writer->tagSlot(id - 1)->minLevel = level;
+  }
+
+  O3LogLevel minLevel() const {
+    return writer && id > 0 ? writer->tagSlot(id - 1)->minLevel : O3LogLevel::Debug;
+  }
+
+private:
+  friend class O3SerialWriter;
+  O3LogTag(O3SerialWriter& owner, uint8_t tagId) : writer(&owner), id(tagId) {}
+
+  template <typename Message>
+  void line(O3LogLevel level, Message message) {
+    if (writer) writer->line(level, id, message);
+  }
+
+  template <typename Format, typename... Args>
+  void formatLine(O3LogLevel level, const Format& text, const Args&... args) {
+    if (writer) writer->formatLine(level, id, text, args...);
+  }
+
+  O3SerialWriter* writer = nullptr;
+  uint8_t id = 0;
+};
+
+inline O3LogTag O3SerialWriter::tag(const char* name) {
+  size_t length = 0;
+  if (name) {
+    while (length + 1 < prefixMaxLen && name[length] != '\0') length++;
+  }
+  return O3LogTag(*this, findOrAddTag(name, false, name, length));
+}
+
+inline O3LogTag O3SerialWriter::tag(const __FlashStringHelper* name) {
+  char text[prefixMaxLen];
+  const size_t length = copyFlash(text, sizeof(text), name);
+  return O3LogTag(*this, findOrAddTag(reinterpret_cast<const char*>(name), true, text, length));
+}
+
+// Logging macros that honor O3_LOG_COMPILE_MIN_LEVEL before the arguments are evaluated.
+// Below the floor they expand to nothing, so expensive arguments are never computed
+// and their string literals do not end up in flash. Binary records get the callsite id.
+//   O3_LOG_DEBUG(sw, "adc", analogRead(A0));
+#if O3_LOG_COMPILE_MIN_LEVEL <= 0
+#define O3_LOG_DEBUG(writer, ...) (writer).logWithId(O3LogLevel::Debug, O3_LOG_CALLSITE_ID, __VA_ARGS__)
+#else
+#define O3_LOG_DEBUG(writer, ...) ((void)0)
+#endif
+
+#if O3_LOG_COMPILE_MIN_LEVEL <= 1
+#define O3_LOG_INFO(writer, ...) (writer).logWithId(O3LogLevel::Info, O3_LOG_CALLSITE_ID, __VA_ARGS__)
+#else
+#define O3_LOG_INFO(writer, ...) ((void)0)
+#endif
+
+#if O3_LOG_COMPILE_MIN_LEVEL <= 2
+#define O3_LOG_WARN(writer, ...) (writer).logWithId(O3LogLevel::Warn, O3_LOG_CALLSITE_ID, __VA_ARGS__)
+#else
+#define O3_LOG_WARN(writer, ...) ((void)0)
+#endif
+
+#if O3_LOG_COMPILE_MIN_LEVEL <= 3
+#define O3_LOG_ERROR(writer, ...) (writer).logWithId(O3LogLevel::Error, O3_LOG_CALLSITE_ID, __VA_ARGS__)
+#else
+#define O3_LOG_ERROR(writer, ...) ((void)0)
+#endif
+
+// State of one sampled callsite, see O3_LOG_EVERY_N. 2 bytes.
+class O3LogEveryN {
+public:
+  // True on the first call and then on every n-th call (n 0 and 1 pass every call).
+  bool pass(uint16_t n) {
+    if (remaining > 0) {
+      remaining--;
+      return false;
+    }
+    remaining = n > 1 ? n - 1 : 0;
+    return true;
+  }
+
+private:
+  uint16_t remaining = 0;
+};
+
+// State of one sampled callsite, see O3_LOG_EVERY_MS. 5 bytes.
+class O3LogEveryMs {
+public:
+  // True on the first call and then on the first call at least ms milliseconds after the last pass.
+  bool pass(uint32_t ms) {
+    const uint32_t now = millis();
+    if (started && now - last < ms) return false;
+    started = true;
+    last = now;
+    return true;
+  }
+
+private:
+  uint32_t last = 0;
+  bool started = false;
+};
+
+// Sampling for callsites that run too often to log every time. Each expansion keeps its own
+// static counter, the statement only runs (and formats its arguments) on the sampled calls:
+//   O3_LOG_EVERY_N(100, sw.debug("adc", analogRead(A0)));   // calls 1, 101, 201, ...
+//   O3_LOG_EVERY_MS(250, motorLog.infof(O3_FMT("rpm=%u"), rpm));
+// The counter does not know the log level, it also counts calls that minLevel would reject.
+#define O3_LOG_EVERY_N(n, statement)     \
+  do {                                   \
+    static O3LogEveryN o3LogSample;      \
+    if (o3LogSample.pass(n)) statement;  \
+  } while (0)
+
+#define O3_LOG_EVERY_MS(ms, statement)   \
+  do {                                   \
+    static O3LogEveryMs o3LogSample;     \
+    if (o3LogSample.pass(ms)) statement; \
+  } while (0)
+
+// Per-level shortcuts. Below O3_LOG_COMPILE_MIN_LEVEL they expand to nothing, counter included.
+//   O3_LOG_DEBUG_EVERY(sw, 100, "adc", value);
+//   O3_LOG_WARN_EVERY_MS(sw, 1000, "overrun", count);
+#if O3_LOG_COMPILE_MIN_LEVEL <= 0
+#define O3_LOG_DEBUG_EVERY(writer, n, ...) O3_LOG_EVERY_N(n, O3_LOG_DEBUG(writer, __VA_ARGS__))
+#define O3_LOG_DEBUG_EVERY_MS(writer, ms, ...) O3_LOG_EVERY_MS(ms, O3_LOG_DEBUG(writer, __VA_ARGS__))
+#else
+#define O3_LOG_DEBUG_EVERY(writer, n, ...) ((void)0)
+#define O3_LOG_DEBUG_EVERY_MS(writer, ms, ...) ((void)0)
+#endif
+
+#if O3_LOG_COMPILE_MIN_LEVEL <= 1
+#define O3_LOG_INFO_EVERY(writer, n, ...) O3_LOG_EVERY_N(n, O3_LOG_INFO(writer, __VA_ARGS__))
+#define O3_LOG_INFO_EVERY_MS(writer, ms, ...) O3_LOG_EVERY_MS(ms, O3_LOG_INFO(writer, __VA_ARGS__))
+#else
+#define O3_LOG_INFO_EVERY(writer, n, ...) ((void)0)
+#define O3_LOG_INFO_EVERY_MS(writer, ms, ...) ((void)0)
+#endif
+
+#if O3_LOG_COMPILE_MIN_LEVEL <= 2
+#define O3_LOG_WARN_EVERY(writer, n, ...) O3_LOG_EVERY_N(n, O3_LOG_WARN(writer, __VA_ARGS__))
+#define O3_LOG_WARN_EVERY_MS(writer, ms, ...) O3_LOG_EVERY_MS(ms, O3_LOG_WARN(writer, __VA_ARGS__))
+#else
+#define O3_LOG_WARN_EVERY(writer, n, ...) ((void)0)
+#define O3_LOG_WARN_EVERY_MS(writer, ms, ...) ((void)0)
+#endif
+
+#if O3_LOG_COMPILE_MIN_LEVEL <= 3
+#define O3_LOG_ERROR_EVERY(writer, n, ...) O3_LOG_EVERY_N(n, O3_LOG_ERROR(writer, __VA_ARGS__))
+#define O3_LOG_ERROR_EVERY_MS(writer, ms, ...) O3_LOG_EVERY_MS(ms, O3_LOG_ERROR(writer, __VA_ARGS__))
+#else
+#define O3_LOG_ERROR_EVERY(writer, n, ...) ((void)0)
+#define O3_LOG_ERROR_EVERY_MS(writer, ms, ...) ((void)0)
+#endif
@@ -0,0 +1,275 @@
+#pragma once
+
+#include "O3SerialWriter.h"
+
+// Options of an O3SyslogSink, passed to begin().
+struct O3SyslogSinkOptions {
+  const char* hostname = "-";       // HOSTNAME field, for example the device name
+  const char* appName = "-";        // APP-NAME field, for example the firmware name
+  uint8_t facility = 16;            // 16 = local0 ... 23 = local7
+  uint32_t flushIntervalMs = 1000;  // Send queued lines at the latest after this long
+  uint32_t retryIntervalMs = 5000;  // Wait this long after a failed send before trying again
+  bool onePerPacket = false;        // One message per datagram (strict RFC 5426) instead of batches
+  bool (*networkUp)() = nullptr;    // Optional check, for example [] { return WiFi.isConnected(); }
+};
+
+// Sends log lines as syslog messages over UDP (WiFiUDP, EthernetUDP, ...).
+//
+// A WiFiClient passed to begin() does one blocking TCP write per print and loses lines when the
+// connection drops. O3SyslogSink only copies each line into a RAM backlog and sends several lines
+// per datagram, when a packet is full or flushIntervalMs after the first queued line. If a send
+// fails (or networkUp() returns false) the lines stay queued, when the backlog is full the oldest
+// lines are dropped. Each line becomes an RFC 5424 message around the usual text line:
+//   <134>1 - node-07 gateway - - - [NET] 12345 INFO: Boot
+// Batches separate the messages with '\n', set onePerPacket for receivers that expect exactly one
+// message per datagram.
+//
+//   WiFiUDP udp;
+//   O3SyslogSink<WiFiUDP> syslog;
+//   syslog.begin(udp, "192.168.1.10", 514, syslogOptions);
+//   sw.addSink(syslog, O3LogLevel::Info);              // needs O3_LOG_MAX_SINKS 2
+//   sw.setSinkFlushLevel(syslog, O3LogLevel::Error);   // errors are sent right away
+//   // in loop(): syslog.flushIfDue();
+//
+// BacklogSize is the RAM for queued lines, PacketSize the largest datagram (keep it below the
+// MTU, 1472 bytes of UDP payload on Ethernet and WiFi). Lines longer than a packet are cut.
+template <typename Udp, size_t BacklogSize = 2048, size_t PacketSize = 1024>
+class O3SyslogSink : public O3LineSink {
+public:
+  O3SyslogSink() = default;
+  O3SyslogSink(const O3SyslogSink&) = delete;
+  O3SyslogSink& operator=(const O3SyslogSink&) = delete;
+
+  // host is an IP address ("192.168.1.10") or a name, which the UDP library resolves per packet.
+  void begin(Udp& socket, const char* host, uint16_t port = 514, const O3SyslogSinkOptions& sinkOptions = O3SyslogSinkOptions()) {
+    udp = &socket;
+    copyText(hostBuffer, sizeof(hostBuffer), host);
+    serverPort = port;
+    options = sinkOptions;
+    renderHeader();
+    sendFailed = false;
+  }
+
+  using Print::write;
+
+  size_t write(uint8_t value) override { return write(&value, 1); }
+
+  size_t write(const uint8_t* data, size_t size) override {
+    if (!lineOpen) beginLine(O3LogLevel::None);
+    append(data, size);
+    return size;
+  }
+
+  // Starts a message: "<PRI>1 - hostname appName - - - ".
+  void beginLine(O3LogLevel level) override {
+    if (lineOpen) endLine();
+    lineOpen = true;
+    lineDropped = false;
+    lineLength = 0;
+    lineStart = writeIndex;
+    if (!reserve(lengthFieldSize)) {
+      lineDropped = true;
+      return;
+    }
+    writeIndex = ringIndex(writeIndex + lengthFieldSize);
+
+    char pri[6];
+    size_t length = 0;
+    pri[length++] = '<';
+    length += O3Format::formatUnsigned(pri + length, static_cast<uint32_t>(options.facility) * 8 + severity(level));
+    pri[length++] = '>';
+    append(reinterpret_cast<const uint8_t*>(pri), length);
+    append(reinterpret_cast<const uint8_t*>(header), headerLength);
+  }
+
+  // Queues the finished message (without its line ending) and sends if a packet is full.
+  void endLine() override {
+    if (!lineOpen) return;
+    lineOpen = false;
+    if (lineDropped) {
+      writeIndex = lineStart;
+      droppedLineCount++;
+      return;
+    }
+    while (lineLength > 0) {
+      const uint8_t last = ring[ringIndex(writeIndex + BacklogSize - 1)];
+      if (last != '\r' && last != '\n') break;
+      writeIndex = ringIndex(writeIndex + BacklogSize - 1);
+      lineLength--;
+    }
+    ring[lineStart] = static_cast<uint8_t>(lineLength & 0xFF);
+    ring[ringIndex(lineStart + 1)] = static_cast<uint8_t>(lineLength >> 8);
+    if (head == tail) queuedSince = millis();
+    head = writeIndex;
+    if (!sendFailed && queuedBytes() >= PacketSize) {
+      send(false);
+    } else {
+      flushIfDue();
+    }
+  }
+
+  // Sends the queued lines if the oldest waited flushIntervalMs (retryIntervalMs after a failed
+  // send). Call it from loop() so the last lines go out even when nothing else is logged.
+  void flushIfDue() {
+    if (head == tail) return;
+    const uint32_t wait = sendFailed ? options.retryIntervalMs : options.flushIntervalMs;
+    if (millis() - queuedSince >= wait) send(true);
+  }
+
+  // Sends everything that is queued now.
+  void flush() override { send(true); }
+
+  // Bytes of complete lines waiting in the backlog.
+  size_t queuedBytes() const { return ringIndex(head + BacklogSize - tail); }
+
+  // Lines lost because the backlog was full.
+  uint32_t droppedLines() const { return droppedLineCount; }
+
+  uint32_t sentPackets() const { return sentPacketCount; }
+
+private:
+  static_assert(PacketSize >= 64 && PacketSize <= 0xFFFF, "PacketSize must be 64..65535");
+  static_assert(BacklogSize > PacketSize, "BacklogSize must hold at least one packet");
+
+  static constexpr size_t lengthFieldSize = 2;
+  static constexpr size_t nameMaxLen = 32;
+
+  Udp* udp = nullptr;
+  char hostBuffer[64] = "";
+  uint16_t serverPort = 514;
+  O3SyslogSinkOptions options;
+
+  // "1 - hostname appName - - - ", the part of the syslog header that is the same for every line.
+  char header[2 + 2 + nameMaxLen + 1 + nameMaxLen + 7 + 1] = "";
+  size_t headerLength = 0;
+
+  // Ring layout like the async buffer: every line is [length low][length high][bytes...],
+  // head only moves once a line is complete. send() advances tail after a datagram went out.
+  uint8_t ring[BacklogSize];
+  size_t head = 0;
+  size_t tail = 0;
+  size_t writeIndex = 0;
+  size_t lineStart = 0;
+  size_t lineLength = 0;
+  bool lineOpen = false;
+  bool lineDropped = false;
+  bool sendFailed = false;
+  uint32_t queuedSince = 0;
+  uint32_t droppedLineCount = 0;
+  uint32_t sentPacketCount = 0;
+
+  static size_t ringIndex(size_t index) { return index % BacklogSize; }
+
+  static size_t copyText(char* target, size_t capacity, const char* value) {
+    size_t i = 0;
+    if (value) {
+      for (; i + 1 < capacity && value[i] != '\0'; i++) target[i] = value[i];
+    }
+    target[i] = '\0';
+    return i;
+  }
+
+  void renderHeader() {
+    size_t length = copyText(header, sizeof(header), "1 - ");
+    length += copyText(header + length, nameMaxLen + 1, options.hostname && options.hostname[0] ? options.hostname : "-");
+    header[length++] = ' ';
+    length += copyText(header + length, nameMaxLen + 1, options.appName && options.appName[0] ? options.appName : "-");
+    length += copyText(header + length, sizeof(header) - length, " - - - ");
+    headerLength = length;
+  }
+
+  // RFC 5424 severities: 3 error, 4 warning, 5 notice, 6 informational, 7 debug.
+  static uint8_t severity(O3LogLevel level) {
+    switch (level) {
+      case O3LogLevel::Debug: return 7;
+      case O3LogLevel::Info:  return 6;
+      case O3LogLevel::Warn:  return 4;
+      case O3LogLevel::Error: return 3;
+      default:                return 5;
+    }
+  }
+
+  size_t freeBytes() const { return BacklogSize - 1 - ringIndex(writeIndex + BacklogSize - tail); }
+
+  // Makes room for size more bytes of the current line by dropping the oldest queued lines.
+  bool reserve(size_t size) {
+    while (freeBytes() < size) {
+      if (tail == head) return false;
+      const size_t length = ring[tail] | (static_cast<size_t>(ring[ringIndex(tail + 1)]) << 8);
+      tail = ringIndex(tail + lengthFieldSize + length);
+      droppedLineCount++;
+    }
+    return true;
+  }
+
+  void append(const uint8_t* data, size_t size) {
+    if (lineDropped) return;
+    if (size > PacketSize - lineLength) size = PacketSize - lineLength; // A message never exceeds a packet
+    if (size == 0) return;
+    if (!reserve(size)) {
+      lineDropped = true;
+      return;
+    }
+    lineLength += size;
+    while (size > 0) {
+      size_t chunk = BacklogSize - writeIndex;
+      if (chunk > size) chunk = size;
+      memcpy(ring + writeIndex, data, chunk);
+      writeIndex = ringIndex(writeIndex + chunk);
+      data += chunk;
+      size -= chunk;
+    }
+  }
+
+  size_t lengthAt(size_t index) const { return ring[index] | (static_cast<size_t>(ring[ringIndex(index + 1)]) << 8); }
+
+  // Writes length bytes of the ring from index on, in at most two pieces.
+  void writeRange(size_t index, size_t length) {
+    const size_t first = BacklogSize - index < length ? BacklogSize - index : length;
+    udp->write(ring + index, first);
+    if (length > first) udp->write(ring, length - first);
+  }
+
+  // Packs queued lines into datagrams until the backlog is empty (all) or less than a full
+  // packet is left, stops at the first failed send.
+  void send(bool all) {
+    if (!udp || head == tail) return;
+    if (options.networkUp && !options.networkUp()) {
+      failed();
+      return;
+    }
+    while (tail != head && (all || queuedBytes() >= PacketSize)) {
+      if (!udp->beginPacket(hostBuffer, serverPort)) {
+        failed();
+        return;
+      }
+      size_t index = tail;
+      size_t packetBytes = 0;
+      while (index != head) {
+        const size_t length = lengthAt(index);
+        if (packetBytes > 0 && (options.onePerPacket || packetBytes + 1 + length > PacketSize)) break;
+        if (packetBytes > 0) {
+          udp->write(static_cast<uint8_t>('\n'));
+          packetBytes++;
+        }
+        writeRange(ringIndex(index + lengthFieldSize), length);
+        packetBytes += length;
+        index = ringIndex(index + lengthFieldSize + length);
+      }
+      if (!udp->endPacket()) {
+        failed();
+        return;
+      }
+      tail = index;
+      sentPacketCount++;
+    }
+    sendFailed = false;
+    if (head != tail) queuedSince = millis();
+  }
+
+  // Keeps the lines and waits retryIntervalMs before the next attempt.
+  void failed() {
+    sendFailed = true;
+    queuedSince = millis();
+  }
+};